@@ -25,6 +25,22 @@ int main() {
 
 		plot.write("default-2d.svg");
 	}
+
+	{ // Compressed output
+		signalsmith::plot::Plot2D plot;
+		plot.x.major(0).tick(10).label("time");
+		plot.y.major(0).minors(-1, 1).label("signal");
+
+		auto &line = plot.line();
+		for (double x = 0; x < 10; x += 0.001) {
+			line.add(x, std::sin(x)*std::cos(x*7));
+		}
+
+		// Files ending in `.svgz` are gzip-compressed, with the level set by `style.compression`
+		auto style = plot.defaultStyle();
+		style.compression = 9;
+		plot.write("compressed.svgz", style);
+	}
 	
 	{ // Demonstrating default colour/dash/hatch/marker sequence
 		signalsmith::plot::Plot2D plot(320, 80);
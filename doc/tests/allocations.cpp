@@ -0,0 +1,103 @@
+#include "../../plot.h"
+#include "../util/test/tests.h"
+
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations (on any thread) while enabled
+#ifdef __GNUC__
+// Stops GCC inlining these and then warning that `free()` is called on memory from `new`
+#	define TEST_NOINLINE __attribute__((noinline))
+#else
+#	define TEST_NOINLINE
+#endif
+static std::atomic<bool> countAllocations{false};
+static std::atomic<size_t> allocationCount{0};
+
+TEST_NOINLINE void * operator new(std::size_t size) {
+	if (countAllocations) ++allocationCount;
+	if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+TEST_NOINLINE void * operator new[](std::size_t size) {
+	return operator new(size);
+}
+TEST_NOINLINE void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+TEST_NOINLINE void operator delete[](void *ptr) noexcept {
+	std::free(ptr);
+}
+TEST_NOINLINE void operator delete(void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+TEST_NOINLINE void operator delete[](void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+struct CountingSink : public signalsmith::plot::OutputSink {
+	size_t bytes = 0;
+	void write(const char *, size_t length) override {
+		bytes += length;
+	}
+	bool good() const override {
+		return true;
+	}
+};
+
+static void fillFigure(signalsmith::plot::Figure &figure) {
+	auto &grid = figure(0, 0);
+	auto &plotA = grid(0, 0).plot(), &plotB = grid(1, 0).plot();
+	plotA.x.linear(0, 10).major(0).minors(5, 10).label("time");
+	plotA.y.linear(-1, 1).major(0).minors(-1, 1).label("signal");
+	plotB.x.linkFrom(plotA.x);
+	plotB.y.linkFrom(plotA.y);
+
+	auto &legend = plotA.legend(2, 1);
+	auto &sine = plotA.line();
+	for (double x = 0; x < 10; x += 0.01) sine.add(x, std::sin(x));
+	sine.marker(5, std::sin(5)).label("sin(x)");
+	auto &filled = plotA.line().fillToY(0);
+	for (double x = 0; x < 10; x += 0.1) filled.add(x, 0.5*std::cos(x));
+	legend.add(sine, "sine").add(filled, "filled", true, true);
+
+	auto &animated = plotB.line();
+	for (double p = 0; p < 2*M_PI; p += 1) {
+		for (double x = 0; x < 10; x += 0.05) animated.add(x, std::sin(x + p));
+		animated.marker(5, std::sin(5 + p));
+		animated.toFrame(p);
+	}
+	animated.loopFrame(2*M_PI);
+}
+
+TEST("Unchanged rewrites don't allocate", rewrite_allocations) {
+	using Simplify = signalsmith::plot::PlotStyle::Simplify;
+	for (bool cacheData : {true, false}) {
+		for (Simplify simplify : {Simplify::streaming, Simplify::douglasPeucker, Simplify::visvalingam}) {
+			for (bool compactPaths : {true, false}) {
+				signalsmith::plot::Figure figure;
+				fillFigure(figure);
+
+				auto style = figure.defaultStyle();
+				style.cacheData = cacheData;
+				style.simplify = simplify;
+				style.compactPaths = compactPaths;
+
+				CountingSink sink;
+				for (int i = 0; i < 3; ++i) figure.write(sink, style);
+				size_t expectedBytes = sink.bytes/3;
+
+				sink.bytes = 0;
+				allocationCount = 0;
+				countAllocations = true;
+				figure.write(sink, style);
+				countAllocations = false;
+
+				if (allocationCount != 0) {
+					return test.fail("allocations: ", size_t(allocationCount), ", cacheData=", cacheData, ", simplify=", int(simplify), ", compactPaths=", compactPaths);
+				}
+				TEST_ASSERT(sink.bytes == expectedBytes);
+			}
+		}
+	}
+}
@@ -0,0 +1,129 @@
+#include "./svg-paths.h"
+#include "../util/test/tests.h"
+
+struct FramePoints {
+	std::vector<double> x, y;
+	void add(double px, double py) {
+		x.push_back(px);
+		y.push_back(py);
+	}
+};
+
+// Fixed axes, so every frame (and the static lines we compare them to) has the same scale
+static void setupAxes(signalsmith::plot::Plot2D &plot) {
+	plot.x.linear(0, 100).blank();
+	plot.y.linear(-2, 2).blank();
+}
+
+// Path data for a static line with the given points
+static std::string staticPath(const FramePoints &frame) {
+	signalsmith::plot::Plot2D plot(100, 100);
+	setupAxes(plot);
+	plot.line().addArray(frame.x, frame.y);
+	auto paths = svgPaths(svgString(plot), "svg-plot-line");
+	return paths.size() ? paths[0] : "";
+}
+
+// The `values` of the line's `<animate>`, split into frames
+static std::vector<std::string> animatedPaths(const std::string &svg) {
+	std::vector<std::string> result;
+	size_t index = svg.find("<path class=\"svg-plot-line");
+	if (index == std::string::npos) return result;
+	index = svg.find("<animate", index);
+	if (index == std::string::npos) return result;
+	index = svg.find(" values=\"", index);
+	if (index == std::string::npos) return result;
+	index += 9;
+	size_t end = svg.find('"', index);
+	while (true) {
+		size_t split = std::min(svg.find(';', index), end);
+		result.push_back(svg.substr(index, split - index));
+		if (split == end) break;
+		index = split + 1;
+	}
+	return result;
+}
+
+// Adds `frames` one at a time (clearing if the next one doesn't start with the previous one), and checks each frame's path
+static void checkFrames(Test &test, const std::vector<FramePoints> &frames, size_t ringCapacity=0) {
+	signalsmith::plot::Plot2D plot(100, 100);
+	setupAxes(plot);
+	auto &line = plot.line();
+	if (ringCapacity) line.ringBuffer(ringCapacity);
+	std::vector<FramePoints> expected;
+	size_t added = 0;
+	for (size_t f = 0; f < frames.size(); ++f) {
+		auto &frame = frames[f];
+		bool clear = (f + 1 == frames.size()) || frames[f + 1].x.size() < frame.x.size()
+			|| !std::equal(frame.x.begin(), frame.x.end(), frames[f + 1].x.begin())
+			|| !std::equal(frame.y.begin(), frame.y.end(), frames[f + 1].y.begin());
+		line.addArray(frame.x.data() + added, frame.y.data() + added, frame.x.size() - added);
+		added = clear ? 0 : frame.x.size();
+		line.toFrame(f, clear);
+
+		FramePoints kept;
+		size_t start = ringCapacity ? frame.x.size() - std::min(frame.x.size(), ringCapacity) : 0;
+		kept.x.assign(frame.x.begin() + start, frame.x.end());
+		kept.y.assign(frame.y.begin() + start, frame.y.end());
+		expected.push_back(kept);
+	}
+	auto paths = animatedPaths(svgString(plot));
+	if (paths.size() != expected.size()) return test.fail("expected ", expected.size(), " frames, got ", paths.size());
+	for (size_t f = 0; f < expected.size(); ++f) {
+		if (paths[f] != staticPath(expected[f])) return test.fail("frame ", f, " differs from a static line");
+	}
+}
+
+static FramePoints wave(size_t size, double phase) {
+	FramePoints frame;
+	for (size_t i = 0; i < size; ++i) frame.add(i*0.03, std::sin(i*0.01 + phase));
+	return frame;
+}
+
+TEST("Frames which only append", frames_append) {
+	// Grows past several 1024-point chunks, without clearing
+	std::vector<FramePoints> frames;
+	for (size_t size = 0; size <= 3000; size += 375) frames.push_back(wave(size, 0));
+	checkFrames(test, frames);
+}
+
+TEST("Frames which shrink after sharing a chunk", frames_shrink) {
+	std::vector<FramePoints> frames;
+	frames.push_back(wave(1500, 0));
+	// Extends the previous frame's second chunk
+	frames.push_back(wave(1800, 0));
+	// Same prefix, but shorter than both previous frames
+	frames.push_back(wave(1200, 0));
+	frames.push_back(wave(1100, 0));
+	frames.push_back(wave(1600, 0));
+	// Shorter than the first chunk
+	frames.push_back(wave(500, 0));
+	frames.push_back(wave(2100, 0));
+	checkFrames(test, frames);
+	
+	// Shrinks, then grows with different data
+	frames.clear();
+	frames.push_back(wave(1500, 0));
+	frames.push_back(wave(1800, 0));
+	frames.push_back(wave(1100, 0));
+	frames.push_back(wave(1800, 1));
+	checkFrames(test, frames);
+}
+
+TEST("Identical and empty frames", frames_identical) {
+	std::vector<FramePoints> frames;
+	frames.push_back(wave(1300, 0));
+	frames.push_back(wave(1300, 0));
+	frames.push_back(wave(1300, 0.5));
+	frames.push_back(wave(1300, 0.5));
+	frames.push_back(FramePoints());
+	frames.push_back(wave(1300, 0.5));
+	frames.push_back(wave(1300, 0.5));
+	checkFrames(test, frames);
+}
+
+TEST("Frames from a ring buffer", frames_ring_buffer) {
+	std::vector<FramePoints> frames;
+	for (size_t size = 0; size <= 4000; size += 450) frames.push_back(wave(size, 0));
+	checkFrames(test, frames, 1500);
+}
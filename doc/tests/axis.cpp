@@ -0,0 +1,51 @@
+#include "../../plot.h"
+#include "../util/test/tests.h"
+
+static bool sameResult(double a, double b) {
+	if (std::isnan(a) || std::isnan(b)) return std::isnan(a) && std::isnan(b);
+	return a == b;
+}
+
+TEST("Axis::mapArray() matches map()", axis_map_array) {
+	std::vector<double> values = {-1e10, -5, -1, -0.0, 0, 1e-300, 0.001, 0.5, 1, 2, 10, 123.456, 1e10, NAN, INFINITY, -INFINITY};
+	for (int i = 0; i < 1000; ++i) values.push_back(test.random(-100, 100));
+
+	auto check = [&](signalsmith::plot::Axis &axis, const char *name) {
+		std::vector<double> mapped(values.size());
+		axis.mapArray(values.data(), mapped.data(), values.size());
+		for (size_t i = 0; i < values.size(); ++i) {
+			if (!sameResult(mapped[i], axis.map(values[i]))) {
+				return test.fail(name, ": value ", values[i], " mapped to ", mapped[i], " instead of ", axis.map(values[i]));
+			}
+		}
+		// In-place
+		std::vector<double> inPlace = values;
+		axis.mapArray(inPlace.data(), inPlace.data(), inPlace.size());
+		for (size_t i = 0; i < values.size(); ++i) {
+			if (!sameResult(inPlace[i], mapped[i])) return test.fail(name, ": in-place mapping differs");
+		}
+	};
+
+	signalsmith::plot::Axis linear(0, 240);
+	linear.linear(-10, 10);
+	check(linear, "linear");
+
+	// Includes values <= 0, which map to NaN/-inf
+	signalsmith::plot::Axis log(130, 0), log2(130, 0), log10(130, 0);
+	log.range(std::log, 0.1, 1000);
+	check(log, "log");
+	log2.range(std::log2, 1, 64);
+	check(log2, "log2");
+	log10.range(std::log10, 1e-3, 1e3);
+	check(log10, "log10");
+
+	signalsmith::plot::Axis custom(0, 100);
+	custom.range(std::function<double(double)>([](double v) {
+		return std::tanh(v*0.1)*0.5 + 0.5;
+	}));
+	check(custom, "custom");
+
+	signalsmith::plot::Axis sqrtAxis(0, 100);
+	sqrtAxis.range(std::sqrt, 0, 100);
+	check(sqrtAxis, "sqrt");
+}
@@ -0,0 +1,46 @@
+#include "./svg-paths.h"
+#include "../util/test/tests.h"
+
+// Both axes are 0-10, on a 100x100 plot, so values map to 10x (with y flipped)
+static void setupAxes(signalsmith::plot::Plot2D &plot) {
+	plot.x.linear(0, 10).blank();
+	plot.y.linear(0, 10).blank();
+}
+
+TEST("Lines leaving and entering the bounds", clip_lines) {
+	for (int simplify = 0; simplify < 3; ++simplify) {
+		signalsmith::plot::Plot2D plot(100, 100);
+		setupAxes(plot);
+		auto &exit = plot.line();
+		exit.add(0, 5).add(5, 5).add(10, 1000).add(15, 5);
+		auto &enter = plot.line();
+		enter.add(0, -1000).add(5, 5).add(6, 5);
+		auto &both = plot.line();
+		both.add(-10, 5).add(20, 5);
+
+		auto style = plot.defaultStyle();
+		style.simplify = signalsmith::plot::PlotStyle::Simplify(simplify);
+		auto paths = svgPaths(svgString(plot, style), "svg-plot-line");
+		TEST_ASSERT(paths.size() == 3);
+		// Lines are written in reverse order, and clipped to the bounds padded by the line width
+		TEST_ASSERT(paths[2] == "M 0 50 50 50 50.26 -2.25");
+		TEST_ASSERT(paths[1] == "M 49.74 102.25 50 50 60 50");
+		TEST_ASSERT(paths[0] == "M -2.25 50 102.25 50");
+	}
+}
+
+TEST("Clipped fills", clip_fills) {
+	signalsmith::plot::Plot2D plot(100, 100);
+	setupAxes(plot);
+	auto &line = plot.line().fillToY(0);
+	line.add(0, 5).add(5, 20).add(10, 5);
+	std::string svg = svgString(plot);
+
+	auto fills = svgPaths(svg, "svg-plot-fill");
+	TEST_ASSERT(fills.size() == 1);
+	TEST_ASSERT(fills[0] == "M 0 50 17.42 -2.25 82.58 -2.25 100 50 100 100 0 100");
+	// The line is split where it leaves and re-enters
+	auto lines = svgPaths(svg, "svg-plot-line");
+	TEST_ASSERT(lines.size() == 1);
+	TEST_ASSERT(lines[0] == "M 0 50 17.42 -2.25 M 82.58 -2.25 100 50");
+}
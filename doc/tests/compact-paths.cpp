@@ -0,0 +1,60 @@
+#include "./svg-paths.h"
+#include "../util/test/tests.h"
+
+namespace {
+	std::string writePath(const std::vector<std::pair<double, double>> &input, bool compact, double precision=100) {
+		signalsmith::plot::BufferSink sink;
+		{
+			signalsmith::plot::SvgWriter svg(sink, signalsmith::plot::Bounds(-1e300, 1e300, -1e300, 1e300), precision);
+			svg.compactPaths = compact;
+			svg.startPath();
+			for (auto &p : input) svg.addPoint(p.first, p.second);
+			svg.endPath();
+		}
+		return sink.str();
+	}
+}
+
+TEST("Compact paths: separators around .5 and -.5", compact_separators) {
+	std::string d = writePath({{0.5, -0.25}, {0.25, -0.13}, {1, 1}, {-0.5, 0.5}}, true);
+	// "-" and a second "." both start a new number, so no spaces are needed there
+	TEST_ASSERT(d == "M.5-.25l-.25.12.75 1.13-1.5-.5");
+	// A number without a "." still needs a space before ".5"
+	d = writePath({{0, 0}, {1, 0.5}, {3, 0.5}}, true);
+	TEST_ASSERT(d == "M0 0l1 .5 2 0");
+}
+
+TEST("Compact paths match absolute paths", compact_matches_absolute) {
+	for (int repeat = 0; repeat < 50; ++repeat) {
+		std::vector<std::pair<double, double>> input;
+		int count = test.randomInt(2, 100);
+		for (int i = 0; i < count; ++i) {
+			// Small values (lots of ".5"/"-.05" style numbers), with occasional large ones
+			double scale = (test.randomInt(0, 10) == 0) ? 1e6 : test.random(0, 2);
+			input.push_back({test.randomInt(-200, 200)*0.01*scale, test.randomInt(-200, 200)*0.01*scale});
+		}
+		bool okCompact, okAbsolute;
+		auto compact = parsePath(writePath(input, true), okCompact);
+		auto absolute = parsePath(writePath(input, false), okAbsolute);
+		TEST_ASSERT(okCompact && okAbsolute);
+		TEST_ASSERT(compact.size() == absolute.size());
+		for (size_t i = 0; i < compact.size(); ++i) {
+			TEST_ASSERT(compact[i].move == absolute[i].move);
+			test.closeEnough(compact[i].x, absolute[i].x, "x", 1e-6);
+			test.closeEnough(compact[i].y, absolute[i].y, "y", 1e-6);
+		}
+	}
+}
+
+TEST("Compact paths with extreme values", compact_extreme) {
+	// Values beyond what `DecimalFormat` can write are clamped, and NaN points are skipped
+	std::string d = writePath({{0, 0}, {1e30, 0}, {0, NAN}, {-1e30, 1}, {2, 1.5}}, true);
+	bool ok;
+	auto points = parsePath(d, ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT(points.size() == 4);
+	TEST_ASSERT(points[1].x == 1e12 && points[1].y == 0);
+	TEST_ASSERT(points[2].x == -1e12 && points[2].y == 1);
+	test.closeEnough(points[3].x, 2.0, "x", 1e-9);
+	test.closeEnough(points[3].y, 1.5, "y", 1e-9);
+}
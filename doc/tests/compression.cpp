@@ -0,0 +1,111 @@
+#include "../../plot.h"
+#include "../util/test/tests.h"
+
+#include <zlib.h>
+
+// Decompresses with zlib, for checking our encoder against an independent decoder
+static bool inflateWith(int windowBits, const std::vector<uint8_t> &compressed, std::vector<uint8_t> &result) {
+	z_stream stream{};
+	if (inflateInit2(&stream, windowBits) != Z_OK) return false;
+	stream.next_in = const_cast<Bytef *>(compressed.data());
+	stream.avail_in = compressed.size();
+	uint8_t chunk[16384];
+	int status;
+	do {
+		stream.next_out = chunk;
+		stream.avail_out = sizeof(chunk);
+		status = inflate(&stream, Z_NO_FLUSH);
+		result.insert(result.end(), chunk, chunk + sizeof(chunk) - stream.avail_out);
+	} while (status == Z_OK);
+	bool complete = (status == Z_STREAM_END && stream.avail_in == 0);
+	inflateEnd(&stream);
+	return complete;
+}
+
+static std::vector<std::vector<uint8_t>> testInputs(Test &test) {
+	std::vector<std::vector<uint8_t>> inputs;
+	inputs.push_back({});
+	inputs.push_back({'x'});
+	// Random bytes (mostly stored blocks)
+	std::vector<uint8_t> noise(100000);
+	for (auto &b : noise) b = test.randomInt(0, 255);
+	inputs.push_back(noise);
+	// Long runs, which produce maximum-length matches
+	inputs.push_back(std::vector<uint8_t>(200000, 'a'));
+	// SVG-like text, longer than the window
+	std::string text;
+	for (int i = 0; text.size() < 300000; ++i) {
+		text += "<path d=\"M" + std::to_string(i%97) + " " + std::to_string(test.randomInt(0, 1000)) + "l3-2\"/>";
+	}
+	inputs.push_back(std::vector<uint8_t>(text.begin(), text.end()));
+	return inputs;
+}
+
+TEST("Deflate round-trip", deflate_round_trip) {
+	auto inputs = testInputs(test);
+	for (int level = 0; level <= 9; ++level) {
+		for (auto &input : inputs) {
+			signalsmith::plot::Deflate deflate(level);
+			std::vector<uint8_t> compressed;
+			// Uneven chunks, to cross the internal buffer boundaries at different points
+			size_t index = 0, chunk = 1;
+			while (index < input.size()) {
+				size_t length = std::min(chunk, input.size() - index);
+				deflate.write(input.data() + index, length, compressed);
+				index += length;
+				chunk = chunk*3 + 7;
+			}
+			deflate.finish(compressed);
+
+			std::vector<uint8_t> output;
+			if (!inflateWith(-15, compressed, output)) return test.fail("invalid DEFLATE stream, level ", level, ", length ", input.size());
+			if (output != input) return test.fail("DEFLATE output doesn't match, level ", level, ", length ", input.size());
+			if (level > 0 && input.size() > 1000 && &input != &inputs[2]) {
+				TEST_ASSERT(compressed.size() < input.size()/2);
+			}
+		}
+	}
+}
+
+TEST("GzipSink round-trip", gzip_round_trip) {
+	for (auto &input : testInputs(test)) {
+		signalsmith::plot::BufferSink buffer;
+		{
+			signalsmith::plot::GzipSink gzip(buffer);
+			gzip.write((const char *)input.data(), input.size());
+			gzip.flush();
+		}
+		std::vector<uint8_t> compressed(buffer.bytes.begin(), buffer.bytes.end());
+		std::vector<uint8_t> output;
+		// zlib checks the gzip CRC-32 and length
+		TEST_ASSERT(inflateWith(16 + 15, compressed, output));
+		TEST_ASSERT(output == input);
+	}
+}
+
+TEST("Checksums match zlib", checksums) {
+	for (auto &input : testInputs(test)) {
+		signalsmith::plot::Crc32 crc;
+		signalsmith::plot::Adler32 adler;
+		crc.add(input.data(), input.size());
+		adler.add(input.data(), input.size());
+		TEST_ASSERT(crc.result() == crc32(0, input.data(), input.size()));
+		TEST_ASSERT(adler.result() == adler32(1, input.data(), input.size()));
+	}
+}
+
+TEST(".svgz output", svgz_output) {
+	signalsmith::plot::Plot2D plot;
+	auto &line = plot.line();
+	for (double x = 0; x < 10; x += 0.01) line.add(x, std::sin(x));
+
+	std::ostringstream expected;
+	plot.write(expected);
+
+	TEST_ASSERT(plot.write("tests-output.svgz"));
+	std::ifstream file("tests-output.svgz", std::ios::binary);
+	std::vector<uint8_t> compressed((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	std::vector<uint8_t> output;
+	TEST_ASSERT(inflateWith(16 + 15, compressed, output));
+	TEST_ASSERT(std::string(output.begin(), output.end()) == expected.str());
+}
@@ -0,0 +1,68 @@
+#include "./svg-paths.h"
+#include "../util/test/tests.h"
+
+TEST("Decimation keeps each column's extremes", decimation_extremes) {
+	// 100pt wide for 0-10, so each unit has 10 columns
+	signalsmith::plot::Plot2D plot(100, 100);
+	plot.x.linear(0, 10).blank();
+	plot.y.linear(-2, 2).blank();
+	auto &line = plot.line();
+	std::vector<double> xs, ys;
+	for (int i = 0; i < 20000; ++i) {
+		double x = i*0.0005;
+		double y = std::sin(x) + test.random(-0.5, 0.5);
+		xs.push_back(x);
+		ys.push_back(y);
+	}
+	line.addArray(xs, ys);
+
+	auto style = plot.defaultStyle();
+	style.decimate = true;
+	// Streaming simplification can trim the ends of spikes, so use one with a strict bound
+	style.simplify = signalsmith::plot::PlotStyle::Simplify::douglasPeucker;
+	auto paths = svgPaths(svgString(plot, style), "svg-plot-line");
+	TEST_ASSERT(paths.size() == 1);
+	bool ok;
+	auto points = parsePath(paths[0], ok);
+	TEST_ASSERT(ok);
+	// At most first/min/max/last for each of the 100 columns
+	TEST_ASSERT(points.size() <= 400);
+	TEST_ASSERT(points.size() >= 200);
+
+	// The min/max of each column (in SVG units) is still drawn, give or take the simplification tolerance.  Columns come from the axis mapping, since e.g. 5.8 maps to 57.999...
+	auto isDrawn = [&](size_t i) {
+		double svgX = plot.x.map(xs[i]), svgY = plot.y.map(ys[i]);
+		for (size_t p = 1; p < points.size(); ++p) {
+			double dx = points[p].x - points[p - 1].x, dy = points[p].y - points[p - 1].y;
+			double t = (svgX - points[p - 1].x)*dx + (svgY - points[p - 1].y)*dy;
+			t = std::max(0.0, std::min(1.0, t/(dx*dx + dy*dy + 1e-100)));
+			if (std::hypot(points[p - 1].x + t*dx - svgX, points[p - 1].y + t*dy - svgY) < 0.05) return true;
+		}
+		return false;
+	};
+	for (int column = 0; column < 100; ++column) {
+		size_t minIndex = 0, maxIndex = 0;
+		bool found = false;
+		for (size_t i = 0; i < xs.size(); ++i) {
+			if (std::floor(plot.x.map(xs[i])) != column) continue;
+			if (!found || ys[i] < ys[minIndex]) minIndex = i;
+			if (!found || ys[i] > ys[maxIndex]) maxIndex = i;
+			found = true;
+		}
+		if (!isDrawn(minIndex)) return test.fail("column ", column, ": minimum not drawn");
+		if (!isDrawn(maxIndex)) return test.fail("column ", column, ": maximum not drawn");
+	}
+}
+
+TEST("Decimation doesn't change sparse lines", decimation_sparse) {
+	signalsmith::plot::Plot2D plot(100, 100);
+	plot.x.linear(0, 10).blank();
+	plot.y.linear(-2, 2).blank();
+	auto &line = plot.line();
+	for (double x = 0; x < 10; x += 0.25) line.add(x, std::sin(x*3));
+
+	auto style = plot.defaultStyle();
+	std::string plain = svgString(plot, style);
+	style.decimate = true;
+	TEST_ASSERT(svgString(plot, style) == plain);
+}
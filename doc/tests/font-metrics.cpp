@@ -0,0 +1,18 @@
+#include "../../plot.h"
+#include "../util/test/tests.h"
+
+TEST("Invalid UTF-8 is measured as U+FFFD", invalid_utf8) {
+	auto &metrics = signalsmith::plot::FontMetrics::builtIn();
+	double replacement = metrics.width("\xEF\xBF\xBD");
+	TEST_ASSERT(replacement > 0);
+	// Each invalid byte is a separate replacement character
+	for (const char *invalid : {"\xF8\x80\x80", "\xFF\xBF\xBF", "\xC0\x80\x80", "\x80\x80\x80"}) {
+		std::ostringstream hex;
+		for (const char *c = invalid; *c; ++c) hex << std::hex << (int)(unsigned char)*c << " ";
+		test.closeEnough(metrics.width(invalid), replacement*3, "invalid bytes: " + hex.str(), 1e-9);
+	}
+	// Valid sequences are one character each
+	test.closeEnough(metrics.width("\xE2\x82\xAC"), metrics.width("\xE2\x82\xAC\xE2\x82\xAC")/2, "3-byte", 1e-9);
+	test.closeEnough(metrics.width("\xF0\x9F\x98\x80"), metrics.width("\xF0\x9F\x98\x80\xF0\x9F\x98\x80")/2, "4-byte", 1e-9);
+	TEST_ASSERT(metrics.width("\xF0\x9F\x98\x80") < replacement*2);
+}
@@ -0,0 +1,250 @@
+#include "./svg-paths.h"
+#include "../util/test/tests.h"
+
+#include <array>
+#include <deque>
+
+// Writes a plot with auto-scaled axes, after `fill(line)` has added the data
+template<class Fill>
+static std::string autoScaledSvg(Fill &&fill) {
+	signalsmith::plot::Plot2D plot(100, 100);
+	auto &line = plot.line();
+	fill(line);
+	return svgString(plot);
+}
+
+static signalsmith::plot::Extent axisExtent(signalsmith::plot::Line2D &line, signalsmith::plot::Axis &axis) {
+	signalsmith::plot::Extent extent;
+	line.axisExtent(axis, extent);
+	return extent;
+}
+
+TEST("addArray() matches add()", add_array) {
+	std::vector<double> xs, ys;
+	for (int i = 0; i < 3000; ++i) {
+		xs.push_back(i*0.01 - 5);
+		ys.push_back(std::sin(i*0.013)*i);
+	}
+	std::string expected = autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		for (size_t i = 0; i < xs.size(); ++i) line.add(xs[i], ys[i]);
+	});
+	TEST_ASSERT(svgPaths(expected, "svg-plot-line").size() == 1);
+
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.addArray(xs, ys);
+	}) == expected);
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.addArray(xs.data(), ys.data(), xs.size());
+	}) == expected);
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		const double *x = xs.data(), *y = ys.data();
+		line.addArray(x, y, xs.size());
+	}) == expected);
+	// Split across several calls, mixed with `.add()`
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.addArray(xs.data(), ys.data(), 1000);
+		line.add(xs[1000], ys[1000]);
+		line.addArray(xs.data() + 1001, ys.data() + 1001, xs.size() - 1001);
+	}) == expected);
+	// Other indexable columns
+	std::deque<double> xDeque(xs.begin(), xs.end()), yDeque(ys.begin(), ys.end());
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.addArray(xDeque, yDeque);
+	}) == expected);
+}
+
+TEST("addArray() with arrays and other element types", add_array_types) {
+	double x[4] = {0, 1, 2, 3}, y[4] = {1, -1, 2, 0.5};
+	std::string expected = autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		for (int i = 0; i < 4; ++i) line.add(x[i], y[i]);
+	});
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.addArray(x, y, 4);
+	}) == expected);
+	std::array<double, 4> xArray{{0, 1, 2, 3}}, yArray{{1, -1, 2, 0.5}};
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.addArray(xArray, yArray);
+	}) == expected);
+	float xFloat[4] = {0, 1, 2, 3}, yFloat[4] = {1, -1, 2, 0.5};
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.addArray(xFloat, yFloat, 4);
+	}) == expected);
+	std::vector<float> xFloatVector(xFloat, xFloat + 4), yFloatVector(yFloat, yFloat + 4);
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.addArray(xFloatVector, yFloatVector);
+	}) == expected);
+}
+
+TEST("addArray() extents", add_array_extents) {
+	signalsmith::plot::Plot2D plot;
+	auto &line = plot.line();
+	std::vector<double> xs = {3, 1, NAN, 4, 1, 5}, ys = {-2, 7, 1, NAN, 8, 2};
+	line.addArray(xs, ys);
+	auto extentX = axisExtent(line, plot.x), extentY = axisExtent(line, plot.y);
+	TEST_ASSERT(extentX.min == 1 && extentX.max == 5);
+	TEST_ASSERT(extentY.min == -2 && extentY.max == 8);
+}
+
+TEST("bind() with strides matches add()", bind_stride) {
+	// Interleaved (x, y, unused) triples
+	std::vector<double> interleaved;
+	for (int i = 0; i < 2000; ++i) {
+		interleaved.push_back(std::cos(i*0.01)*i);
+		interleaved.push_back(std::sin(i*0.017)*i);
+		interleaved.push_back(1e10);
+	}
+	size_t size = interleaved.size()/3;
+	std::string expected = autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		for (size_t i = 0; i < size; ++i) line.add(interleaved[i*3], interleaved[i*3 + 1]);
+	});
+	TEST_ASSERT(svgPaths(expected, "svg-plot-line").size() == 1);
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.bind(interleaved.data(), interleaved.data() + 1, size, 3, 3);
+	}) == expected);
+
+	// Adding after `.bind()` copies the bound points first
+	expected = autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		for (size_t i = 0; i < size; ++i) line.add(interleaved[i*3], interleaved[i*3 + 1]);
+		line.add(0, 0);
+	});
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.bind(interleaved.data(), interleaved.data() + 1, size, 3, 3);
+		line.add(0, 0);
+	}) == expected);
+
+	signalsmith::plot::Plot2D plot;
+	auto &line = plot.line();
+	std::vector<double> xy = {3, -2, 1, 7, NAN, 1, 4, NAN, 1, 8, 5, 2};
+	line.bind(xy.data(), xy.data() + 1, xy.size()/2, 2, 2);
+	auto extentX = axisExtent(line, plot.x), extentY = axisExtent(line, plot.y);
+	TEST_ASSERT(extentX.min == 1 && extentX.max == 5);
+	TEST_ASSERT(extentY.min == -2 && extentY.max == 8);
+}
+
+TEST("bind() with implicit x matches add()", bind_implicit_x) {
+	std::vector<double> ys;
+	for (int i = 0; i < 3000; ++i) {
+		ys.push_back(std::sin(i*0.02)*(1 + i*0.001));
+	}
+	double xStart = -3, xStep = 0.25;
+	std::string expected = autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		for (size_t i = 0; i < ys.size(); ++i) line.add(xStart + i*xStep, ys[i]);
+	});
+	TEST_ASSERT(svgPaths(expected, "svg-plot-line").size() == 1);
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.bind(xStart, xStep, ys.data(), ys.size());
+	}) == expected);
+
+	// Every other value, e.g. one channel of stereo audio
+	expected = autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		for (size_t i = 0; i*2 < ys.size(); ++i) line.add(xStart + i*xStep, ys[i*2]);
+	});
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.bind(xStart, xStep, ys.data(), ys.size()/2, 2);
+	}) == expected);
+
+	signalsmith::plot::Plot2D plot;
+	auto &line = plot.line();
+	line.bind(10, -2, ys.data(), 6, 2);
+	auto extentX = axisExtent(line, plot.x), extentY = axisExtent(line, plot.y);
+	TEST_ASSERT(extentX.min == 0 && extentX.max == 10);
+	double minY = ys[0], maxY = ys[0];
+	for (int i = 0; i < 6; ++i) {
+		minY = std::min(minY, ys[i*2]);
+		maxY = std::max(maxY, ys[i*2]);
+	}
+	TEST_ASSERT(extentY.min == minY && extentY.max == maxY);
+}
+
+TEST("Ring buffers keep the most recent points", ring_buffer) {
+	std::vector<double> xs, ys;
+	for (int i = 0; i < 3000; ++i) {
+		xs.push_back(i*0.1);
+		ys.push_back(std::sin(i*0.05) + i*0.001);
+	}
+	auto lastPoints = [&](size_t end, size_t count) {
+		return autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+			for (size_t i = end - count; i < end; ++i) line.add(xs[i], ys[i]);
+		});
+	};
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.ringBuffer(500);
+		for (size_t i = 0; i < 1700; ++i) line.add(xs[i], ys[i]);
+	}) == lastPoints(1700, 500));
+	// Bulk additions, including more than the capacity at once
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.ringBuffer(500);
+		line.addArray(xs.data(), ys.data(), 321);
+		line.addArray(xs.data() + 321, ys.data() + 321, 1234);
+	}) == lastPoints(1555, 500));
+	// Changing the capacity while wrapped around
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.ringBuffer(500);
+		for (size_t i = 0; i < 1700; ++i) line.add(xs[i], ys[i]);
+		line.ringBuffer(300);
+	}) == lastPoints(1700, 300));
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.ringBuffer(300);
+		for (size_t i = 0; i < 1700; ++i) line.add(xs[i], ys[i]);
+		line.ringBuffer(0);
+		for (size_t i = 1700; i < 2000; ++i) line.add(xs[i], ys[i]);
+	}) == lastPoints(2000, 600));
+	// Bound data is limited once more points are added
+	TEST_ASSERT(autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+		line.ringBuffer(500);
+		line.bind(xs.data(), ys.data(), 1000);
+		line.add(xs[1000], ys[1000]);
+	}) == lastPoints(1001, 500));
+}
+
+TEST("Ring buffer extents follow the window", ring_buffer_extents) {
+	signalsmith::plot::Plot2D plot;
+	auto &line = plot.line();
+	size_t capacity = 50;
+	line.ringBuffer(capacity);
+	std::vector<double> xs, ys;
+	for (int i = 0; i < 2000; ++i) {
+		// Rises and falls, so the minimum and maximum both expire from the window
+		double y = std::sin(i*0.03)*(i%97 == 0 ? 10 : 1) + test.random(-0.1, 0.1);
+		if (i%31 == 0) y = NAN;
+		xs.push_back(i%200 - (i/200)*10.0);
+		ys.push_back(y);
+		if (i%500 < 100) {
+			line.addArray(xs.data() + i, ys.data() + i, 1);
+		} else {
+			line.add(xs[i], ys[i]);
+		}
+		// Only ask for the extent sometimes, so the window is also rebuilt from the points
+		if (i%3 == 0 || i%250 > 200) continue;
+		signalsmith::plot::Extent expectedX, expectedY;
+		for (size_t j = xs.size() - std::min(xs.size(), capacity); j < xs.size(); ++j) {
+			expectedX.include(xs[j]);
+			expectedY.include(ys[j]);
+		}
+		auto extentX = axisExtent(line, plot.x), extentY = axisExtent(line, plot.y);
+		if (extentX.min != expectedX.min || extentX.max != expectedX.max) return test.fail("x extent at ", i);
+		if (extentY.min != expectedY.min || extentY.max != expectedY.max) return test.fail("y extent at ", i);
+	}
+}
+
+TEST("Auto-tracking axes follow a ring buffer", ring_buffer_tracking) {
+	signalsmith::plot::Plot2D plot(100, 100);
+	plot.x.autoTrack();
+	plot.y.autoTrack();
+	auto &line = plot.line();
+	line.ringBuffer(200);
+	std::vector<double> xs, ys;
+	for (int i = 0; i < 1000; ++i) {
+		xs.push_back(i);
+		ys.push_back(i < 500 ? i*0.5 : 500 - i);
+		line.add(xs[i], ys[i]);
+		if (i%150 != 149) continue;
+
+		std::string d = svgPaths(svgString(plot), "svg-plot-line")[0];
+		std::string expected = autoScaledSvg([&](signalsmith::plot::Line2D &line) {
+			size_t count = std::min<size_t>(xs.size(), 200);
+			line.addArray(xs.data() + xs.size() - count, ys.data() + ys.size() - count, count);
+		});
+		if (d != svgPaths(expected, "svg-plot-line")[0]) return test.fail("path after ", i + 1, " points");
+	}
+}
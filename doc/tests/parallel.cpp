@@ -0,0 +1,62 @@
+#include "./svg-paths.h"
+#include "../util/test/tests.h"
+
+#include <stdexcept>
+
+TEST("parallelFor() calls each index once", parallel_for_indices) {
+	for (int threads : {1, 2, 4, 16}) {
+		for (size_t count : {0, 1, 3, 100, 10000}) {
+			std::vector<std::atomic<int>> calls(count);
+			for (auto &c : calls) c = 0;
+			signalsmith::plot::parallelFor(count, threads, [&](size_t i) {
+				++calls[i];
+			});
+			for (auto &c : calls) TEST_ASSERT(c == 1);
+		}
+	}
+}
+
+TEST("parallelFor() rethrows exceptions on the calling thread", parallel_for_exceptions) {
+	for (int repeat = 0; repeat < 20; ++repeat) {
+		bool caught = false;
+		try {
+			signalsmith::plot::parallelFor(1000, 4, [&](size_t i) {
+				if (i == 500) throw std::runtime_error("oops");
+			});
+		} catch (const std::runtime_error &e) {
+			caught = (std::string(e.what()) == "oops");
+		}
+		TEST_ASSERT(caught);
+	}
+	// The pool still works afterwards
+	std::atomic<size_t> total{0};
+	signalsmith::plot::parallelFor(100, 4, [&](size_t i) {
+		total += i;
+	});
+	TEST_ASSERT(total == 4950);
+}
+
+TEST("Threaded grid output matches single-threaded", parallel_grid) {
+	signalsmith::plot::Figure figure;
+	for (int c = 0; c < 3; ++c) {
+		for (int r = 0; r < 2; ++r) {
+			auto &plot = figure(c, r).plot(100, 80);
+			auto &line = plot.line();
+			for (double x = 0; x < 10; x += 0.1) line.add(x, std::sin(x*(c + 1) + r));
+			line.label("line");
+		}
+	}
+	auto style = figure.defaultStyle();
+	auto expectedPaths = svgPaths(svgString(figure, style), "svg-plot-line");
+	TEST_ASSERT(expectedPaths.size() == 6);
+	// Element IDs are scoped per cell when threaded, so only the path data matches the single-threaded output
+	style.threads = 2;
+	std::string expected = svgString(figure, style);
+	TEST_ASSERT(svgPaths(expected, "svg-plot-line") == expectedPaths);
+	for (int threads : {2, 4, 16}) {
+		style.threads = threads;
+		for (int repeat = 0; repeat < 3; ++repeat) {
+			TEST_ASSERT(svgString(figure, style) == expected);
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#include "./svg-paths.h"
+#include "../util/test/tests.h"
+
+static double segmentDistance(double px, double py, const SvgPathPoint &a, const SvgPathPoint &b) {
+	double dx = b.x - a.x, dy = b.y - a.y;
+	double length2 = dx*dx + dy*dy;
+	double t = length2 ? ((px - a.x)*dx + (py - a.y)*dy)/length2 : 0;
+	t = std::max(0.0, std::min(1.0, t));
+	return std::hypot(a.x + dx*t - px, a.y + dy*t - py);
+}
+
+// The default streaming simplification accumulates error, so it isn't strictly bounded like these
+TEST("Simplified lines stay within tolerance", simplify_tolerance) {
+	using Simplify = signalsmith::plot::PlotStyle::Simplify;
+	for (Simplify simplify : {Simplify::douglasPeucker, Simplify::visvalingam}) {
+		for (double tolerance : {0.1, 0.5, 2.0}) {
+			signalsmith::plot::Plot2D plot(100, 100);
+			plot.x.linear(0, 10).blank();
+			plot.y.linear(-2, 2).blank();
+			auto &line = plot.line();
+			std::vector<double> svgX, svgY;
+			for (double x = 0; x <= 10; x += 0.01) {
+				double y = std::sin(x*2) + 0.3*std::sin(x*13);
+				line.add(x, y);
+				svgX.push_back(x*10);
+				svgY.push_back(50 - y*25);
+			}
+
+			auto style = plot.defaultStyle();
+			style.simplify = simplify;
+			style.simplifyTolerance = tolerance;
+			auto paths = svgPaths(svgString(plot, style), "svg-plot-line");
+			TEST_ASSERT(paths.size() == 1);
+			bool ok;
+			auto points = parsePath(paths[0], ok);
+			TEST_ASSERT(ok);
+			TEST_ASSERT(points.size() >= 2 && points.size() < svgX.size()/2);
+
+			// Endpoints are kept
+			test.closeEnough(points[0].x, svgX[0], "start x", 0.01);
+			test.closeEnough(points[0].y, svgY[0], "start y", 0.01);
+			test.closeEnough(points.back().x, svgX.back(), "end x", 0.01);
+			test.closeEnough(points.back().y, svgY.back(), "end y", 0.01);
+
+			// Every data point is close to the drawn line
+			size_t segment = 0;
+			for (size_t i = 0; i < svgX.size(); ++i) {
+				// x is increasing, so find the segment covering this point
+				while (segment + 2 < points.size() && points[segment + 1].x < svgX[i]) ++segment;
+				double distance = segmentDistance(svgX[i], svgY[i], points[segment], points[segment + 1]);
+				if (segment > 0) distance = std::min(distance, segmentDistance(svgX[i], svgY[i], points[segment - 1], points[segment]));
+				if (distance > tolerance + 0.02) {
+					return test.fail("simplify=", int(simplify), ", tolerance=", tolerance, ": point ", i, " is ", distance, " from the line");
+				}
+			}
+		}
+	}
+}
+
+TEST("Douglas-Peucker and Visvalingam keep original points", simplify_subset) {
+	using Simplify = signalsmith::plot::PlotStyle::Simplify;
+	for (Simplify simplify : {Simplify::douglasPeucker, Simplify::visvalingam}) {
+		signalsmith::plot::Plot2D plot(100, 100);
+		plot.x.linear(0, 10).blank();
+		plot.y.linear(-2, 2).blank();
+		auto &line = plot.line();
+		std::vector<double> svgX, svgY;
+		for (int i = 0; i <= 500; ++i) {
+			double x = i*0.02, y = test.random(-1, 1);
+			line.add(x, y);
+			svgX.push_back(x*10);
+			svgY.push_back(50 - y*25);
+		}
+		auto style = plot.defaultStyle();
+		style.simplify = simplify;
+		style.simplifyTolerance = 1;
+		bool ok;
+		auto points = parsePath(svgPaths(svgString(plot, style), "svg-plot-line")[0], ok);
+		TEST_ASSERT(ok);
+		for (auto &p : points) {
+			bool found = false;
+			for (size_t i = 0; i < svgX.size() && !found; ++i) {
+				found = std::abs(p.x - svgX[i]) < 0.01 && std::abs(p.y - svgY[i]) < 0.01;
+			}
+			if (!found) return test.fail("simplify=", int(simplify), ": drawn point ", p.x, ",", p.y, " isn't in the data");
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#include "../../plot.h"
+#include "../util/test/tests.h"
+
+TEST("Compiled style tables follow later changes", style_tables) {
+	signalsmith::plot::PlotStyle style;
+	style.compile();
+	TEST_ASSERT(style.markerHref(1) == "#svg-plot-marker1");
+	TEST_ASSERT(style.strokeClass(6) == "svg-plot-s0");
+
+	style.defsHref = "defs.svg";
+	TEST_ASSERT(style.markerHref(1) == "defs.svg#svg-plot-marker1");
+	style.colours.push_back("#888");
+	TEST_ASSERT(style.strokeClass(6) == "svg-plot-s6");
+	style.markers.push_back("<rect x=\"-1\" y=\"-1\" width=\"2\" height=\"2\"/>");
+	TEST_ASSERT(style.markerId(5) == "svg-plot-marker5");
+
+	std::string css = style.minifiedCss();
+	style.cssSuffix = ".extra{fill:red}";
+	TEST_ASSERT(style.minifiedCss() != css);
+	TEST_ASSERT(style.minifiedCss().find(".extra{fill:red}") != std::string::npos);
+}
+
+TEST("Style copies keep the compiled tables", style_copies) {
+	signalsmith::plot::PlotStyle style;
+	style.defsHref = "a.svg";
+	style.compile();
+	signalsmith::plot::PlotStyle copy = style;
+	copy.defsHref = "b.svg";
+	TEST_ASSERT(style.markerHref(0) == "a.svg#svg-plot-marker0");
+	TEST_ASSERT(copy.markerHref(0) == "b.svg#svg-plot-marker0");
+	copy = style;
+	TEST_ASSERT(copy.markerHref(0) == "a.svg#svg-plot-marker0");
+}
@@ -0,0 +1,99 @@
+#ifndef PLOT_TESTS_SVG_PATHS_H
+#define PLOT_TESTS_SVG_PATHS_H
+
+#include "../../plot.h"
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <cctype>
+
+// The `d` attribute of each `<path>` whose class starts with `classPrefix` (e.g. "svg-plot-line"), in document order
+inline std::vector<std::string> svgPaths(const std::string &svg, const std::string &classPrefix) {
+	std::vector<std::string> result;
+	std::string classAttr = "<path class=\"" + classPrefix;
+	size_t index = 0;
+	while ((index = svg.find(classAttr, index)) != std::string::npos) {
+		size_t end = svg.find('>', index);
+		size_t d = svg.find(" d=\"", index);
+		if (d == std::string::npos || d > end) {
+			index = end;
+			continue;
+		}
+		d += 4;
+		result.push_back(svg.substr(d, svg.find('"', d) - d));
+		index = end;
+	}
+	return result;
+}
+
+// A point from parsed path data, in absolute coordinates
+struct SvgPathPoint {
+	bool move;
+	double x, y;
+};
+
+// Parses M/m/L/l path data (using the SVG number grammar, so "-.25.12" is two numbers) into absolute points
+inline std::vector<SvgPathPoint> parsePath(const std::string &d, bool &ok) {
+	std::vector<SvgPathPoint> points;
+	ok = true;
+	char command = 0;
+	bool firstPair = false;
+	double x = 0, y = 0;
+	size_t i = 0;
+	auto skipSpace = [&]() {
+		while (i < d.size() && (d[i] == ' ' || d[i] == ',')) ++i;
+	};
+	auto number = [&](double &result) {
+		skipSpace();
+		size_t start = i;
+		if (i < d.size() && (d[i] == '-' || d[i] == '+')) ++i;
+		size_t digits = 0;
+		while (i < d.size() && std::isdigit((unsigned char)d[i])) ++i, ++digits;
+		if (i < d.size() && d[i] == '.') {
+			++i;
+			while (i < d.size() && std::isdigit((unsigned char)d[i])) ++i, ++digits;
+		}
+		if (!digits) return false;
+		if (i < d.size() && (d[i] == 'e' || d[i] == 'E')) {
+			++i;
+			if (i < d.size() && (d[i] == '-' || d[i] == '+')) ++i;
+			while (i < d.size() && std::isdigit((unsigned char)d[i])) ++i;
+		}
+		result = std::stod(d.substr(start, i - start));
+		return true;
+	};
+	while (true) {
+		skipSpace();
+		if (i >= d.size()) break;
+		if (std::isalpha((unsigned char)d[i])) {
+			command = d[i++];
+			firstPair = true;
+			continue;
+		}
+		double a, b;
+		if (!command || !number(a) || !number(b)) {
+			ok = false;
+			break;
+		}
+		bool relative = (command == 'm' || command == 'l') && !points.empty();
+		x = relative ? x + a : a;
+		y = relative ? y + b : b;
+		points.push_back({(command == 'M' || command == 'm') && firstPair, x, y});
+		firstPair = false;
+	}
+	return points;
+}
+
+template<class Drawable>
+std::string svgString(Drawable &drawable, const signalsmith::plot::PlotStyle &style) {
+	std::ostringstream stream;
+	drawable.write(stream, style);
+	return stream.str();
+}
+template<class Drawable>
+std::string svgString(Drawable &drawable) {
+	return svgString(drawable, drawable.defaultStyle());
+}
+
+#endif
@@ -256,6 +256,11 @@ private:
 //		for (auto &v : unitValues) scale.autoValue(v);
 //		scale.autoSetup();
 	
+		// Map all the values up-front, using the scale's batch mapping
+		std::vector<double> scaledValues(unitValues.size());
+		scale.mapArray(unitValues.data(), scaledValues.data(), unitValues.size());
+		for (auto &v : scaledValues) v = std::max(0.0, std::min(1.0, v));
+
 		double scaleX = outputWidth > 1 ? (width - 1.0)/(outputWidth - 1.0) : (width - 1.0);
 		double scaleY = outputHeight > 1 ? (height - 1.0)/(outputHeight - 1.0) : (height - 1.0);
 		auto getScaledPixel = [&](int outX, int outY) {
@@ -271,7 +276,7 @@ private:
 					double wy = 1 - std::abs(y - inY)/spanY;
 					wy *= wy*(3 - 2*wy);
 					double w = wx*wy;
-					double v = std::max(0.0, std::min(1.0, scale.map((*this)(x, y))));
+					double v = scaledValues[x + y*width];
 					scaledSum += v*w;
 					counter += w;
 				}
@@ -309,7 +314,10 @@ private:
 		}
 
 		// Image data
-		startChunk("IDAT").startDeflate();
+		startChunk("IDAT");
+		addBytes("\x78\x9C", 2); // zlib header
+		Deflate deflate;
+		Adler32 adler;
 		std::vector<unsigned char> rowBytes(outputWidth + 1), prevBytes(outputWidth + 1);
 		rowBytes[0] = 3; // "average" filter (left and up)
 		for (int y = 0; y < outputHeight; ++y) {
@@ -325,9 +333,11 @@ private:
 				rowBytes[x + 1] = (byte - predicted);
 				leftByte = prevBytes[x + 1] = byte;
 			}
-			deflate(rowBytes.data(), rowBytes.size(), y == outputHeight - 1);
+			adler.add(rowBytes.data(), rowBytes.size());
+			deflate.write(rowBytes.data(), rowBytes.size(), pngBytes);
 		}
-		endDeflate().endChunk();
+		deflate.finish(pngBytes);
+		addInt32(adler.result()).endChunk();
 		startChunk("IEND").endChunk();
 	}
 	
@@ -362,88 +372,10 @@ private:
 		uint32_t size = pngBytes.size() - chunkStartIndex - 8;
 		writeInt(size, 4, chunkStartIndex);
 
-		// CRC-32
+		Crc32 crc;
 		size_t crcStart = chunkStartIndex + 4;
-		uint32_t crc = 0xFFFFFFFFu;
-		for (size_t b = crcStart; b < pngBytes.size(); ++b) {
-			uint8_t byte = pngBytes[b];
-			uint32_t val = (crc^byte)&0xFF;
-			for (int i = 0; i < 8; ++i) {
-				val = (val&1) ? (val>>1)^0xEDB88320 : (val>>1);
-			}
-			crc = val^(crc>>8);
-		}
-		addInt32(crc^0xFFFFFFFF);
-	}
-	uint32_t adlerA, adlerB;
-	void startDeflate() {
-		addBytes("\x78\x01", 2); // zlib header
-		adlerA = 1;
-		adlerB = 0;
-	}
-	uint32_t pending = 0, pendingBits = 0;
-	void writeCode(uint32_t v, int bits, bool flipped=true) {
-		// DEFLATE codes are written MSB first, so we flip all the codes around
-		for (int b = 0; b < bits; ++b) {
-			int b2 = flipped ? (bits - 1 - b) : b;
-			pending |= ((v>>b2)&1)<<pendingBits;
-			++pendingBits;
-		}
-		while (pendingBits >= 8) {
-			pngBytes.push_back(pending&0xff);
-			pending = pending>>8;
-			pendingBits -= 8;
-		}
-	}
-	void deflate(const unsigned char *block, int length, bool isFinal) {
-		for (int i = 0; i < length; ++i) {
-			uint32_t c = block[i];
-			adlerA = (adlerA + c)%65521;
-			adlerB = (adlerB + adlerA)%65521;
-		}
-
-		writeCode(2 + isFinal, 3, false); // fixed-code Huffman, with final-block flag
-		// Very limited search for repeating sections
-		int writeIndex = 0;
-		while (writeIndex < length) {
-			int bestDistance = 0, bestLength = 1;
-			for (int d = 1; d <= 4 && d < writeIndex; ++d) {
-				int sequenceLength = 0;
-				while (writeIndex + sequenceLength < length && sequenceLength < 18) {
-					int sourceIndex = writeIndex - d + (sequenceLength%d);
-					if (block[writeIndex + sequenceLength] != block[sourceIndex]) break;
-					++sequenceLength;
-				}
-				if (sequenceLength > bestLength) {
-					bestLength = sequenceLength;
-					bestDistance = d;
-				}
-			}
-			if (bestLength >= 3) {
-				if (bestLength <= 10) {
-					writeCode(bestLength - 2, 7);
-				} else { // we limit the sequences to 18
-					int extra = (bestLength - 11);
-					writeCode(9 + extra/2, 7);
-					writeCode(extra, 1);
-				}
-				writeCode(bestDistance - 1, 5); // no extra bits, because we only searched 4 back
-				writeIndex += bestLength;
-			} else { // literals in DEFLATE's fixed Huffman
-				uint32_t c = block[writeIndex];
-				if (c <= 143) {
-					writeCode(c + 48, 8);
-				} else {
-					writeCode(c + 0x100, 9);
-				}
-				++writeIndex;
-			}
-		}
-		writeCode(0, 7); // end-of-block code
-	}
-	HeatMap & endDeflate() {
-		if (pendingBits) writeCode(0, 8 - pendingBits);
-		return addInt32(adlerA + adlerB*65536);
+		crc.add(pngBytes.data() + crcStart, pngBytes.size() - crcStart);
+		addInt32(crc.result());
 	}
 };
 
@@ -8,8 +8,37 @@
 #include <memory>
 #include <functional>
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <queue>
+#include <deque>
+#include <type_traits>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <unordered_map>
+
+#ifndef SIGNALSMITH_PLOT_POSIX
+#	if defined(__unix__) || defined(__APPLE__)
+#		define SIGNALSMITH_PLOT_POSIX 1
+#	else
+#		define SIGNALSMITH_PLOT_POSIX 0
+#	endif
+#endif
+#if SIGNALSMITH_PLOT_POSIX
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <cerrno>
+#endif
 
 namespace signalsmith { namespace plot {
 
@@ -28,7 +57,274 @@ namespace signalsmith { namespace plot {
 	@file
 **/
 
-static double estimateUtf8Width(const char *utf8Str);
+static double estimateCharWidth(int c);
+
+/** Character widths (as a fraction of the font size), for estimating text sizes - the actual font isn't known until the SVG is displayed.
+	By default, this uses a built-in table (measured from a typical sans-serif font), but widths can be loaded from the font you expect to be used:
+	\code
+		auto metrics = std::make_shared<FontMetrics>();
+		if (metrics->load("DejaVuSans.ttf")) style.fontMetrics = metrics;
+	\endcode
+*/
+class FontMetrics {
+	double ascii[128];
+	std::unordered_map<int32_t, double> widths;
+	unsigned long idValue;
+	// Memoised widths for non-ASCII strings, which have to be decoded
+	mutable std::mutex cacheMutex;
+	mutable std::unordered_map<std::string, double> cache;
+
+	static unsigned long nextId() {
+		static std::atomic<unsigned long> counter{0};
+		return ++counter;
+	}
+
+	void setWidth(int32_t c, double w) {
+		if (c >= 0 && c < 128) {
+			ascii[c] = w;
+		} else {
+			widths[c] = w;
+		}
+	}
+	/// Decodes one UTF-8 character, returning `U+FFFD` (and skipping a single byte) if it's invalid
+	static int32_t decode(const unsigned char *&bytes, const unsigned char *end) {
+		int32_t c = *bytes++;
+		if (c < 0x80) return c;
+		int extra = (c >= 0xF0 && c < 0xF5) ? 3 : (c >= 0xE0 && c < 0xF0) ? 2 : (c >= 0xC2 && c < 0xE0) ? 1 : 0;
+		if (!extra || end - bytes < extra) return 0xFFFD;
+		c &= 0x3F >> extra;
+		for (int i = 0; i < extra; ++i) {
+			if ((bytes[i]&0xC0) != 0x80) return 0xFFFD;
+			c = (c<<6) | (bytes[i]&0x3F);
+		}
+		// Overlong encodings, surrogates and anything past U+10FFFF
+		static const int32_t minValue[4] = {0, 0x80, 0x800, 0x10000};
+		if (c < minValue[extra] || (c >= 0xD800 && c < 0xE000) || c > 0x10FFFF) return 0xFFFD;
+		bytes += extra;
+		return c;
+	}
+
+	bool loadSfnt(const std::vector<unsigned char> &data);
+	bool loadAfm(const std::vector<unsigned char> &data);
+public:
+	FontMetrics() : idValue(nextId()) {
+		for (int c = 0; c < 128; ++c) ascii[c] = estimateCharWidth(c);
+	}
+	FontMetrics(const FontMetrics &other) = delete;
+
+	/// Shared instance with the built-in widths
+	static const FontMetrics & builtIn() {
+		static const FontMetrics metrics;
+		return metrics;
+	}
+
+	/** Loads advance widths from a TrueType/OpenType font (its `cmap`/`hmtx` tables) or an AFM file, returning `false` if the file couldn't be read.
+		Characters which aren't in the file keep their existing widths. */
+	bool load(const std::string &fontFile) {
+		std::ifstream file(fontFile, std::ios::binary);
+		if (!file) return false;
+		std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (data.size() < 16) return false;
+		bool ok = (std::memcmp(data.data(), "StartFontMetrics", 16) == 0) ? loadAfm(data) : loadSfnt(data);
+		if (ok) {
+			idValue = nextId();
+			std::lock_guard<std::mutex> lock(cacheMutex);
+			cache.clear();
+		}
+		return ok;
+	}
+
+	/// Unique to this object, and changes whenever its widths do (for cache keys)
+	unsigned long id() const {
+		return idValue;
+	}
+
+	/// Width of a single Unicode character
+	double charWidth(int32_t c) const {
+		if (c >= 0 && c < 128) return ascii[c];
+		auto iter = widths.find(c);
+		if (iter != widths.end()) return iter->second;
+		return estimateCharWidth(c);
+	}
+
+	/// Width of a UTF-8 string
+	double width(const char *utf8, size_t length) const {
+		auto *bytes = (const unsigned char *)utf8, *end = bytes + length;
+		// ASCII fast path, checking 16 bytes at a time
+		double total = 0;
+		while (end - bytes >= 16) {
+			uint64_t a, b;
+			std::memcpy(&a, bytes, 8);
+			std::memcpy(&b, bytes + 8, 8);
+			if ((a|b)&0x8080808080808080ull) break;
+			for (int i = 0; i < 16; ++i) total += ascii[bytes[i]];
+			bytes += 16;
+		}
+		while (bytes != end && *bytes < 0x80) total += ascii[*bytes++];
+		if (bytes == end) return total;
+
+		std::string key(utf8, length);
+		{
+			std::lock_guard<std::mutex> lock(cacheMutex);
+			auto iter = cache.find(key);
+			if (iter != cache.end()) return iter->second;
+		}
+		while (bytes != end) total += charWidth(decode(bytes, end));
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		if (cache.size() >= 4096) cache.clear();
+		cache[key] = total;
+		return total;
+	}
+	double width(const std::string &utf8) const {
+		return width(utf8.data(), utf8.size());
+	}
+};
+
+inline bool FontMetrics::loadSfnt(const std::vector<unsigned char> &data) {
+	bool ok = true;
+	auto u16 = [&](size_t offset) -> uint32_t {
+		if (offset + 2 > data.size()) return ok = false;
+		return (uint32_t(data[offset])<<8) | data[offset + 1];
+	};
+	auto u32 = [&](size_t offset) -> uint32_t {
+		return (u16(offset)<<16) | u16(offset + 2);
+	};
+	size_t base = 0;
+	uint32_t version = u32(0);
+	if (version == 0x74746366/*ttcf*/) { // font collection, so use the first one
+		base = u32(12);
+		version = u32(base);
+	}
+	if (version != 0x00010000 && version != 0x74727565/*true*/ && version != 0x4F54544F/*OTTO*/) return false;
+
+	size_t head = 0, hhea = 0, hmtx = 0, cmap = 0;
+	for (uint32_t t = 0, tableCount = u16(base + 4); t < tableCount && ok; ++t) {
+		size_t record = base + 12 + 16*t;
+		uint32_t tag = u32(record), offset = u32(record + 8);
+		if (tag == 0x68656164/*head*/) head = offset;
+		if (tag == 0x68686561/*hhea*/) hhea = offset;
+		if (tag == 0x686D7478/*hmtx*/) hmtx = offset;
+		if (tag == 0x636D6170/*cmap*/) cmap = offset;
+	}
+	if (!head || !hhea || !hmtx || !cmap) return false;
+	double unitsPerEm = u16(head + 18);
+	uint32_t metricCount = u16(hhea + 34);
+	if (!unitsPerEm || !metricCount) return false;
+	// Glyphs past the end of `hmtx` use the last advance width
+	auto advance = [&](uint32_t glyph) {
+		return u16(hmtx + 4*std::min(glyph, metricCount - 1))/unitsPerEm;
+	};
+
+	// Prefer a full-Unicode (format 12) character map, then a BMP (format 4) one
+	size_t format4 = 0, format12 = 0;
+	for (uint32_t t = 0, tableCount = u16(cmap + 2); t < tableCount && ok; ++t) {
+		size_t record = cmap + 4 + 8*t;
+		uint32_t platform = u16(record), encoding = u16(record + 2);
+		if (platform != 0 && !(platform == 3 && (encoding == 1 || encoding == 10))) continue;
+		size_t subtable = cmap + u32(record + 4);
+		uint32_t format = u16(subtable);
+		if (format == 4 && !format4) format4 = subtable;
+		if (format == 12 && !format12) format12 = subtable;
+	}
+	std::vector<std::pair<int32_t, double>> found;
+	if (format12) {
+		for (uint32_t g = 0, groupCount = u32(format12 + 12); g < groupCount && ok; ++g) {
+			size_t group = format12 + 16 + 12*g;
+			uint32_t start = u32(group), end = std::min<uint32_t>(u32(group + 4), 0x10FFFF), glyph = u32(group + 8);
+			for (uint32_t c = start; c <= end && ok; ++c) {
+				found.emplace_back(c, advance(glyph + (c - start)));
+			}
+		}
+	} else if (format4) {
+		uint32_t segCount = u16(format4 + 6)/2;
+		size_t ends = format4 + 14, starts = ends + 2*segCount + 2, deltas = starts + 2*segCount, rangeOffsets = deltas + 2*segCount;
+		for (uint32_t s = 0; s < segCount && ok; ++s) {
+			uint32_t start = u16(starts + 2*s), end = std::min<uint32_t>(u16(ends + 2*s), 0xFFFE);
+			uint32_t delta = u16(deltas + 2*s), rangeOffset = u16(rangeOffsets + 2*s);
+			for (uint32_t c = start; c <= end && ok; ++c) {
+				uint32_t glyph = c;
+				if (rangeOffset) {
+					glyph = u16(rangeOffsets + 2*s + rangeOffset + 2*(c - start));
+					if (!glyph) continue;
+				}
+				glyph = (glyph + delta)&0xFFFF;
+				if (glyph) found.emplace_back(c, advance(glyph));
+			}
+		}
+	} else {
+		return false;
+	}
+	if (!ok) return false;
+	for (auto &pair : found) setWidth(pair.first, pair.second);
+	return true;
+}
+
+inline bool FontMetrics::loadAfm(const std::vector<unsigned char> &data) {
+	std::istringstream stream(std::string(data.begin(), data.end()));
+	std::string line;
+	bool inMetrics = false, any = false;
+	while (std::getline(stream, line)) {
+		if (line.compare(0, 16, "StartCharMetrics") == 0) {
+			inMetrics = true;
+		} else if (line.compare(0, 14, "EndCharMetrics") == 0) {
+			break;
+		} else if (inMetrics) {
+			// e.g. "C 65 ; WX 667 ; N A ; B 8 0 654 718 ;"
+			long code = -1;
+			double wx = -1;
+			std::string name, field;
+			std::istringstream fields(line);
+			while (std::getline(fields, field, ';')) {
+				std::istringstream parts(field);
+				std::string key;
+				parts >> key;
+				if (key == "C") parts >> code;
+				if (key == "WX" || key == "W0X") parts >> wx;
+				if (key == "N") parts >> name;
+			}
+			if (wx < 0) continue;
+			int32_t c = -1;
+			if (name.size() == 7 && name.compare(0, 3, "uni") == 0) {
+				c = std::strtol(name.c_str() + 3, nullptr, 16);
+			} else if (name == "quoteright") {
+				c = 0x2019; // Adobe StandardEncoding differs from ASCII for these two
+			} else if (name == "quoteleft") {
+				c = 0x2018;
+			} else if (code >= 32 && code < 127) {
+				c = code;
+			}
+			if (c >= 0) {
+				setWidth(c, wx*0.001);
+				any = true;
+			}
+		}
+	}
+	return any;
+}
+
+/// Byte-string key for cached output, built from the values the output depends on
+struct CacheKey {
+	std::string bytes;
+
+	template<class T>
+	CacheKey & add(T value) {
+		static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "only plain values (without padding) can be added");
+		bytes.append((const char *)&value, sizeof(T));
+		return *this;
+	}
+	CacheKey & add(const std::string &str) {
+		add(str.size());
+		bytes += str;
+		return *this;
+	}
+	bool operator==(const CacheKey &other) const {
+		return bytes == other.bytes;
+	}
+	/// Empties the key, keeping its storage
+	void clear() {
+		bytes.clear();
+	}
+};
 
 /** Plotting style, used for both layout and SVG rendering.
 	Colour/dash/hatch styles are defined as CSS classes, assigned to elements based on their integer style index.  CSS is written inline in the SVG, and can be extended/overridden with `.cssPrefix`/`.cssSuffix`.
@@ -45,13 +341,38 @@ public:
 	// Text
 	double labelSize = 12, valueSize = 10;
 	double fontAspectRatio = 1; ///< scales size estimates, if using a particularly wide font
+	/// Character widths used to estimate text sizes (the built-in table if empty)
+	std::shared_ptr<const FontMetrics> fontMetrics;
+	const FontMetrics & metrics() const {
+		return fontMetrics ? *fontMetrics : FontMetrics::builtIn();
+	}
 	double textPadding = 5, lineHeight = 1.2;
 	// Fills
 	double fillOpacity = 0.28;
 	double hatchWidth = 1, hatchSpacing = 3;
 	double animation = 2; ///< Animation duration
+	/// Writes paths using relative moves on the precision grid (shorter, but less readable)
+	bool compactPaths = false;
+	int compression = 6; ///< gzip level (0-9) used for `.svgz` files
+	/// Reduces dense lines to the first/min/max/last points in each pixel-column (1pt at `.scale`), before drawing
+	bool decimate = false;
+	/// Line simplification: `streaming` (single pass, accumulating error), `douglasPeucker` or `visvalingam`
+	enum class Simplify {streaming, douglasPeucker, visvalingam};
+	Simplify simplify = Simplify::streaming;
+	/// How far (in pixels - 1pt at `.scale`) simplified lines can move from the data.  If this is 0, it uses the output precision.
+	double simplifyTolerance = 0;
+	/// Threads used for layout and writing (0 = use all cores).  Line data is the same as single-threaded, but `Grid` cells use separate element IDs.
+	int threads = 1;
+	int threadCount() const {
+		return (threads > 0) ? threads : std::max<int>(1, std::thread::hardware_concurrency());
+	}
+	/// Keeps each line's SVG output between writes, and re-uses it if nothing it depends on has changed (e.g. for plots which are re-written as some lines get new data)
+	bool cacheData = false;
 
 	std::string scriptHref = "", scriptSrc = "";
+	/** If set, the CSS and marker definitions are referenced from external files (e.g. `.writeCss()`/`.writeDefs()`) instead of included in each SVG.
+		This can save a lot of space when publishing many plots with the same style.  Hatch masks are still inline, since they depend on each plot's size. */
+	std::string cssHref = "", defsHref = "";
 	std::string cssPrefix = "", cssSuffix = "";
 	std::vector<std::string> colours = {"#0073E6", "#CC0000", "#00B300", "#806600", "#E69900", "#CC00CC"};
 	std::vector<std::vector<double>> dashes = {{}, {1.2, 1.2}, {2.8, 1.6}, {5, 4}, {4, 1, 1, 1, 1, 1}, {10, 3}, {4, 2, 1, 2}};
@@ -104,28 +425,50 @@ public:
 			return Counter(colour, dash, hatch, index);
 		}
 	};
-	std::string strokeClass(const Counter &counter) const {
-		if (counter.colour < 0 || colours.size() == 0) return "svg-plot-s";
-		return "svg-plot-s" + std::to_string(counter.colour%(int)colours.size());
-	}
-	std::string fillClass(const Counter &counter) const {
-		if (counter.colour < 0 || colours.size() == 0) return "svg-plot-f";
-		return "svg-plot-f" + std::to_string(counter.colour%(int)colours.size());
-	}
-	std::string textClass(const Counter &counter) const {
-		if (counter.colour < 0 || colours.size() == 0) return "svg-plot-t";
-		return "svg-plot-t" + std::to_string(counter.colour%(int)colours.size());
-	}
-	std::string dashClass(const Counter &counter) const {
-		if (counter.dash < 0 || dashes.size() == 0) return "svg-plot-d";
-		return "svg-plot-d" + std::to_string(counter.dash%(int)dashes.size());
+	// Class names are looked up in the compiled tables (see `.compile()`), where index 0 is the un-numbered class
+	const std::string & strokeClass(const Counter &counter) const {
+		return compiledClass(&Compiled::stroke, counter.colour, colours.size());
+	}
+	const std::string & fillClass(const Counter &counter) const {
+		return compiledClass(&Compiled::fill, counter.colour, colours.size());
+	}
+	const std::string & textClass(const Counter &counter) const {
+		return compiledClass(&Compiled::text, counter.colour, colours.size());
+	}
+	const std::string & dashClass(const Counter &counter) const {
+		return compiledClass(&Compiled::dash, counter.dash, dashes.size());
+	}
+	const std::string & hatchClass(const Counter &counter) const {
+		return compiledClass(&Compiled::hatch, counter.hatch, hatches.size());
+	}
+	/// Adds every setting (except `.threads`/`.cacheData`, which don't change the output) to a cache key
+	void cacheKey(CacheKey &key) const {
+		key.add(scale).add(padding).add(lineWidth).add(precision).add(markerSize).add(tickH).add(tickV);
+		key.add(labelSize).add(valueSize).add(fontAspectRatio).add(metrics().id()).add(textPadding).add(lineHeight);
+		key.add(fillOpacity).add(hatchWidth).add(hatchSpacing).add(animation);
+		key.add(compactPaths).add(compression).add(decimate).add(simplify).add(simplifyTolerance);
+		key.add(scriptHref).add(scriptSrc).add(cssPrefix).add(cssSuffix).add(cssHref).add(defsHref);
+		key.add(colours.size());
+		for (auto &c : colours) key.add(c);
+		key.add(dashes.size());
+		for (auto &d : dashes) {
+			key.add(d.size());
+			for (auto v : d) key.add(v);
+		}
+		key.add(markers.size());
+		for (auto &m : markers) key.add(m);
+		key.add(hatches.size());
+		for (auto &h : hatches) {
+			key.add(h.angles.size()).add(h.lineScale).add(h.spaceScale);
+			for (auto a : h.angles) key.add(a);
+		}
 	}
-	std::string hatchClass(const Counter &counter) const {
-		if (counter.hatch < 0 || hatches.size() == 0) return "svg-plot-h";
-		return "svg-plot-h" + std::to_string(counter.hatch%(int)hatches.size());
+	const std::string & markerId(const Counter &counter) const {
+		return compiledTables().markerIds[std::abs(counter.marker)%(int)markers.size()];
 	}
-	std::string markerId(const Counter &counter) const {
-		return "svg-plot-marker" + std::to_string(std::abs(counter.marker)%(int)markers.size());
+	/// Link to the marker definition, which is external if `.defsHref` is set
+	const std::string & markerHref(const Counter &counter) const {
+		return compiledTables().markerHrefs[std::abs(counter.marker)%(int)markers.size()];
 	}
 	const std::string & markerRaw(const Counter &counter) const {
 		int index = std::abs(counter.marker)%(int)markers.size();
@@ -242,6 +585,115 @@ public:
 		}
 		o << cssSuffix;
 	}
+
+	/** Compiles the style into minified CSS and class-name tables, if it's changed since they were last compiled.
+		`SvgFileDrawable::write()` calls this before writing, so the write itself doesn't allocate for CSS or class names.  A style can be shared by concurrent writes, as long as it isn't modified during them. */
+	void compile() const {
+		CacheKey key;
+		cacheKey(key);
+		compile(key);
+	}
+	/// Compiles using a key already filled in by `.cacheKey()`
+	void compile(const CacheKey &key) const {
+		std::lock_guard<std::mutex> lock(compileLock.mutex);
+		if (compiled && compiled->key == key) return;
+		compiled = std::make_shared<const Compiled>(*this, key);
+	}
+	/// Minified CSS, as written into the SVG
+	const std::string & minifiedCss() const {
+		compile();
+		return compiled->css;
+	}
+	const std::string & minifiedCss(const CacheKey &key) const {
+		compile(key);
+		return compiled->css;
+	}
+
+	/// Writes the CSS for use with `.cssHref`
+	void writeCss(std::ostream &o) const {
+		o << minifiedCss();
+	}
+	void writeCss(const std::string &cssFile) const {
+		std::ofstream file(cssFile, std::ios::binary);
+		writeCss(file);
+	}
+	/// Writes an SVG sprite with the marker definitions (and CSS), for use with `.defsHref`
+	void writeDefs(std::ostream &o) const {
+		o << "<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"no\"?>\n";
+		o << "<svg version=\"1.1\" class=\"svg-plot\" xmlns=\"http://www.w3.org/2000/svg\"><style>" << minifiedCss() << "</style><defs>";
+		for (size_t i = 0; i < markers.size(); ++i) {
+			o << "<g id=\"" << markerId(i) << "\" class=\"svg-plot-marker\">" << markers[i] << "</g>";
+		}
+		o << "</defs></svg>";
+	}
+	void writeDefs(const std::string &svgFile) const {
+		std::ofstream file(svgFile, std::ios::binary);
+		writeDefs(file);
+	}
+private:
+	struct Compiled {
+		CacheKey key;
+		std::string css;
+		std::vector<std::string> stroke, fill, text, dash, hatch, markerIds, markerHrefs;
+		// Everything the class/ID tables are built from
+		size_t colourCount, dashCount, hatchCount, markerCount;
+		std::string defsHref;
+
+		Compiled(const PlotStyle &style, const CacheKey &key) : key(key), colourCount(style.colours.size()), dashCount(style.dashes.size()), hatchCount(style.hatches.size()), markerCount(style.markers.size()), defsHref(style.defsHref) {
+			auto addClasses = [](std::vector<std::string> &names, const char *prefix, size_t count) {
+				names.push_back(prefix);
+				for (size_t i = 0; i < count; ++i) names.push_back(prefix + std::to_string(i));
+			};
+			addClasses(stroke, "svg-plot-s", colourCount);
+			addClasses(fill, "svg-plot-f", colourCount);
+			addClasses(text, "svg-plot-t", colourCount);
+			addClasses(dash, "svg-plot-d", dashCount);
+			addClasses(hatch, "svg-plot-h", hatchCount);
+			for (size_t i = 0; i < markerCount; ++i) {
+				markerIds.push_back("svg-plot-marker" + std::to_string(i));
+				markerHrefs.push_back(style.defsHref + "#" + markerIds.back());
+			}
+
+			std::stringstream cssStream;
+			style.css(cssStream);
+			std::string source = cssStream.str();
+			// Strip whitespace that doesn't appear between letters/numbers
+			bool letter = false, letterThenWhitespace = false;
+			for (char c : source) {
+				if (c == '\t' || c == '\n' || c == ' ') {
+					letterThenWhitespace = letter;
+				} else {
+					letter = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '.' || c == ')' || c == ']';
+					if (letterThenWhitespace && letter) css += ' ';
+					letterThenWhitespace = false;
+					css += c;
+				}
+			}
+		}
+	};
+	mutable std::shared_ptr<const Compiled> compiled;
+	// Each copy of the style gets its own lock, so writes with different styles don't wait for each other
+	struct CompileLock {
+		std::mutex mutex;
+		CompileLock() {}
+		CompileLock(const CompileLock &) {}
+		CompileLock & operator=(const CompileLock &) {
+			return *this;
+		}
+	};
+	mutable CompileLock compileLock;
+	/// Tables from the last `.compile()`, unless anything they're built from (the numbers of colours/dashes/hatches/markers, or `.defsHref`) has changed since then
+	const Compiled & compiledTables() const {
+		if (!compiled || compiled->colourCount != colours.size() || compiled->dashCount != dashes.size() || compiled->hatchCount != hatches.size() || compiled->markerCount != markers.size() || compiled->defsHref != defsHref) {
+			compile();
+		}
+		return *compiled;
+	}
+	const std::string & compiledClass(std::vector<std::string> Compiled::*names, int index, size_t count) const {
+		const Compiled &tables = compiledTables();
+		if (index < 0 || count == 0) return (tables.*names)[0];
+		return (tables.*names)[1 + index%(int)count];
+	}
 };
 
 struct Bounds {
@@ -274,52 +726,956 @@ struct Point2D {
 	double x, y;
 };
 
+/// Min/max of some values, ignoring NaNs
+struct Extent {
+	double min = HUGE_VAL, max = -HUGE_VAL;
+	bool valid() const {
+		return min <= max;
+	}
+	Extent & include(double v) {
+		min = (v < min) ? v : min;
+		max = (v > max) ? v : max;
+		return *this;
+	}
+	Extent & include(const Extent &other) {
+		min = std::min(min, other.min);
+		max = std::max(max, other.max);
+		return *this;
+	}
+	/// A single pass over (possibly strided) values
+	Extent & include(const double *values, size_t size, size_t stride=1) {
+		double newMin = min, newMax = max;
+		if (stride == 1) {
+			for (size_t i = 0; i < size; ++i) {
+				double v = values[i];
+				newMin = (v < newMin) ? v : newMin;
+				newMax = (v > newMax) ? v : newMax;
+			}
+		} else {
+			for (size_t i = 0; i < size; ++i) {
+				double v = values[i*stride];
+				newMin = (v < newMin) ? v : newMin;
+				newMax = (v > newMax) ? v : newMax;
+			}
+		}
+		min = newMin;
+		max = newMax;
+		return *this;
+	}
+};
+
+/** Locale-independent number formatting, which doesn't allocate.
+	Values are rounded to a multiple of `1/precision`, and written as the shortest decimal which rounds back to the same multiple.
+*/
+class DecimalFormat {
+	double precision, invPrecision;
+public:
+	/// Buffer size required by `.write()`
+	static constexpr int maxLength = 24;
+
+	DecimalFormat(double precision) : precision(precision), invPrecision(1.0/precision) {}
+
+	double round(double v) const {
+		return std::round(v*precision)*invPrecision;
+	}
+
+	/// Writes into `buffer`, returning the length.  Returns 0 for values it can't handle (non-finite or very large), so the caller can fall back to `std::ostream`.
+	int write(double v, char *buffer) const {
+		double scaled = std::round(v*precision);
+		if (!(std::abs(scaled) < 1e15)) return 0; // also catches NaN
+		if (scaled == 0) {
+			buffer[0] = '0';
+			return 1;
+		}
+		// Find the fewest decimal places which round back to the same value
+		double value = scaled*invPrecision, digitScale = 1;
+		long long digits = std::llround(value);
+		int places = 0;
+		while (std::round(digits/digitScale*precision) != scaled && places < 17) {
+			digitScale *= 10;
+			++places;
+			digits = std::llround(value*digitScale);
+		}
+		return writeFixed(digits, places, buffer);
+	}
+
+	/// Writes `digits*10^-places`, returning the length
+	static int writeFixed(long long digits, int places, char *buffer) {
+		char reversed[maxLength];
+		int length = 0, count = 0;
+		unsigned long long remaining = (digits < 0) ? -(unsigned long long)digits : digits;
+		while (remaining || count <= places) {
+			if (count == places && places > 0) reversed[count++] = '.';
+			reversed[count++] = '0' + (remaining%10);
+			remaining /= 10;
+		}
+		if (digits < 0) buffer[length++] = '-';
+		while (count > 0) buffer[length++] = reversed[--count];
+		return length;
+	}
+
+	/** Writes with a given number of significant figures, returning the length.
+		This matches `std::ostream`'s default output, returning 0 for values which that would write in exponent notation. */
+	static int writeSignificant(double v, int figures, char *buffer) {
+		if (v == 0) {
+			buffer[0] = '0';
+			return 1;
+		}
+		int exponent = std::floor(std::log10(std::abs(v)));
+		if (!(exponent >= -4 && exponent < figures)) return 0; // also catches NaN
+		// Rounding up might push it into the next power of 10
+		double precision = std::pow(10.0, figures - 1 - exponent);
+		if (std::abs(std::round(v*precision)) >= std::pow(10.0, figures)) {
+			if (++exponent >= figures) return 0;
+			precision *= 0.1;
+		}
+		return DecimalFormat(precision).write(v, buffer);
+	}
+};
+
+/** Destination for SVG output.
+	`SvgWriter` collects small writes into a buffer, so these receive fairly large blocks.
+*/
+class OutputSink {
+public:
+	virtual ~OutputSink() {}
+	virtual void write(const char *data, size_t length) = 0;
+	/// Called when the output is complete
+	virtual void flush() {}
+	/// Whether everything so far has been written successfully
+	virtual bool good() const {
+		return true;
+	}
+};
+
+/// Writes to a `std::ostream`
+class StreamSink : public OutputSink {
+	std::ostream &stream;
+public:
+	StreamSink(std::ostream &stream) : stream(stream) {}
+
+	void write(const char *data, size_t length) override {
+		stream.write(data, length);
+	}
+	void flush() override {
+		stream.flush();
+	}
+	bool good() const override {
+		return stream.good();
+	}
+};
+
+/// Collects output in a growable contiguous buffer
+class BufferSink : public OutputSink {
+public:
+	std::vector<char> bytes;
+
+	void write(const char *data, size_t length) override {
+		bytes.insert(bytes.end(), data, data + length);
+	}
+	const char * data() const {
+		return bytes.data();
+	}
+	size_t size() const {
+		return bytes.size();
+	}
+	/// Empties the buffer, but keeps the allocated memory
+	void clear() {
+		bytes.clear();
+	}
+	std::string str() const {
+		return std::string(bytes.begin(), bytes.end());
+	}
+};
+
+/** Writes to a file in large blocks.
+	This uses a raw file descriptor where available (`SIGNALSMITH_PLOT_POSIX`), and `std::FILE` otherwise.
+*/
+class FileSink : public OutputSink {
+	std::vector<char> block;
+	size_t blockUsed = 0;
+	bool ok;
+#if SIGNALSMITH_PLOT_POSIX
+	int fd;
+	void writeBlock(const char *data, size_t length) {
+		while (ok && length > 0) {
+			ssize_t written = ::write(fd, data, length);
+			if (written < 0) {
+				if (errno != EINTR) ok = false;
+				continue;
+			}
+			data += written;
+			length -= written;
+		}
+	}
+public:
+	FileSink(const std::string &file, size_t blockSize=1<<20) : block(blockSize) {
+		fd = ::open(file.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		ok = (fd >= 0);
+	}
+	~FileSink() {
+		flush();
+		if (fd >= 0) ::close(fd);
+	}
+#else
+	std::FILE *file;
+	void writeBlock(const char *data, size_t length) {
+		if (ok && std::fwrite(data, 1, length, file) != length) ok = false;
+	}
+public:
+	FileSink(const std::string &fileName, size_t blockSize=1<<20) : block(blockSize) {
+		file = std::fopen(fileName.c_str(), "wb");
+		ok = (file != nullptr);
+		if (ok) std::setvbuf(file, nullptr, _IONBF, 0); // we do our own buffering
+	}
+	~FileSink() {
+		flush();
+		if (file) std::fclose(file);
+	}
+#endif
+	FileSink(const FileSink &other) = delete;
+
+	void write(const char *data, size_t length) override {
+		if (blockUsed + length > block.size()) {
+			flush();
+			if (length >= block.size()) return writeBlock(data, length);
+		}
+		std::memcpy(block.data() + blockUsed, data, length);
+		blockUsed += length;
+	}
+	void flush() override {
+		writeBlock(block.data(), blockUsed);
+		blockUsed = 0;
+	}
+	bool good() const override {
+		return ok;
+	}
+};
+
+#if SIGNALSMITH_PLOT_POSIX
+/** Writes to a memory-mapped file.
+	The file is extended in large steps as output arrives, and truncated to the correct length when complete.
+*/
+class MappedFileSink : public OutputSink {
+	int fd;
+	char *mapped = nullptr;
+	size_t mappedSize = 0, used = 0, growSize;
+	bool ok;
+
+	void unmap() {
+		if (mapped) ::munmap(mapped, mappedSize);
+		mapped = nullptr;
+		mappedSize = 0;
+	}
+	void reserve(size_t size) {
+		size_t newSize = std::max(mappedSize*2, used + size + growSize);
+		unmap();
+		if (::ftruncate(fd, newSize) != 0) {
+			ok = false;
+			return;
+		}
+		void *ptr = ::mmap(nullptr, newSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+		if (ptr == MAP_FAILED) {
+			ok = false;
+			return;
+		}
+		mapped = (char *)ptr;
+		mappedSize = newSize;
+	}
+public:
+	MappedFileSink(const std::string &file, size_t growSize=1<<22) : growSize(growSize) {
+		fd = ::open(file.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+		ok = (fd >= 0);
+	}
+	~MappedFileSink() {
+		flush();
+		unmap();
+		if (fd >= 0) ::close(fd);
+	}
+	MappedFileSink(const MappedFileSink &other) = delete;
+
+	void write(const char *data, size_t length) override {
+		if (!ok) return;
+		if (used + length > mappedSize) {
+			reserve(length);
+			if (!ok) return;
+		}
+		std::memcpy(mapped + used, data, length);
+		used += length;
+	}
+	void flush() override {
+		// The mapping extends past the truncated end, so drop it - `reserve()` remaps if more is written
+		unmap();
+		if (ok && ::ftruncate(fd, used) != 0) ok = false;
+	}
+	bool good() const override {
+		return ok;
+	}
+};
+#endif
+
+/// CRC-32 checksum, as used by PNG and gzip
+class Crc32 {
+	uint32_t value = 0xFFFFFFFFu;
+
+	struct Table {
+		uint32_t entries[256];
+		Table() {
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint32_t v = i;
+				for (int b = 0; b < 8; ++b) {
+					v = (v&1) ? (v>>1)^0xEDB88320u : (v>>1);
+				}
+				entries[i] = v;
+			}
+		}
+	};
+public:
+	void add(const uint8_t *data, size_t length) {
+		static const Table table;
+		for (size_t i = 0; i < length; ++i) {
+			value = table.entries[(value^data[i])&0xFF]^(value>>8);
+		}
+	}
+	uint32_t result() const {
+		return value^0xFFFFFFFFu;
+	}
+};
+
+/// Adler-32 checksum, as used by zlib streams
+class Adler32 {
+	uint32_t a = 1, b = 0;
+public:
+	void add(const uint8_t *data, size_t length) {
+		while (length > 0) {
+			// Largest block which can't overflow before the modulo
+			size_t block = std::min<size_t>(length, 5552);
+			for (size_t i = 0; i < block; ++i) {
+				a += data[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+			data += block;
+			length -= block;
+		}
+	}
+	uint32_t result() const {
+		return a + b*65536;
+	}
+};
+
+/** DEFLATE (RFC 1951) compressor, using LZ77 with hash-chains and Huffman coding.
+	Each block uses whichever of stored/fixed/dynamic codes is smallest.  The compression `level` goes from 0 (no compression) to 9 (slowest).
+
+	This only produces the raw DEFLATE data - wrappers (zlib/gzip) are up to the caller.
+*/
+class Deflate {
+	static constexpr int windowSize = 32768, minMatch = 3, maxMatch = 258;
+	// Furthest back we look, leaving space for the lookahead
+	static constexpr int maxDistance = windowSize - maxMatch - minMatch - 1;
+	static constexpr int hashBits = 15, maxSymbols = 16384;
+	static constexpr int lengthCodes = 29, distanceCodes = 30;
+
+	struct Symbol {
+		uint16_t litLen; // literal (0-255) or match length
+		uint16_t distance; // 0 for literals
+	};
+	struct Tables {
+		uint8_t lengthCode[256]; // by (length - 3)
+		uint8_t distanceCode[512]; // see `distanceCodeFor()`
+		uint16_t lengthBase[lengthCodes], distanceBase[distanceCodes];
+		uint8_t lengthExtra[lengthCodes], distanceExtra[distanceCodes];
+		Tables() {
+			int length = 3;
+			for (int c = 0; c < lengthCodes; ++c) {
+				lengthExtra[c] = (c < 8 || c == 28) ? 0 : (c - 4)/4;
+				lengthBase[c] = (c == 28) ? 258 : length;
+				for (int i = 0; i < (1<<lengthExtra[c]) && length < 258; ++i) {
+					lengthCode[(length++) - 3] = c;
+				}
+			}
+			lengthCode[255] = 28;
+			int distance = 1;
+			for (int c = 0; c < distanceCodes; ++c) {
+				distanceExtra[c] = (c < 4) ? 0 : c/2 - 1;
+				distanceBase[c] = distance;
+				for (int i = 0; i < (1<<distanceExtra[c]); ++i) {
+					if (distance <= 256) {
+						distanceCode[distance - 1] = c;
+					} else {
+						distanceCode[256 + ((distance - 1)>>7)] = c;
+					}
+					++distance;
+				}
+			}
+		}
+		int distanceCodeFor(int distance) const {
+			return (distance <= 256) ? distanceCode[distance - 1] : distanceCode[256 + ((distance - 1)>>7)];
+		}
+	};
+	static const Tables & tables() {
+		static const Tables t;
+		return t;
+	}
+
+	int level, maxChain, niceLength;
+	bool lazy;
+	std::vector<uint8_t> buffer; // history and pending input
+	size_t processed = 0, hashed = 0, blockStart = 0;
+	std::vector<int32_t> head, prev;
+	std::vector<Symbol> symbols;
+	uint64_t bitBuffer = 0;
+	int bitCount = 0;
+
+	void putBits(uint32_t value, int bits, std::vector<uint8_t> &out) {
+		bitBuffer |= uint64_t(value)<<bitCount;
+		bitCount += bits;
+		while (bitCount >= 8) {
+			out.push_back(bitBuffer&0xFF);
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	}
+	void alignToByte(std::vector<uint8_t> &out) {
+		if (bitCount > 0) putBits(0, 8 - bitCount, out);
+	}
+
+	int hashAt(size_t pos) const {
+		uint32_t v = (uint32_t(buffer[pos])<<16)|(uint32_t(buffer[pos + 1])<<8)|buffer[pos + 2];
+		return (v*2654435761u)>>(32 - hashBits);
+	}
+	void insertUpTo(size_t pos) {
+		while (hashed < pos && hashed + minMatch <= buffer.size()) {
+			int h = hashAt(hashed);
+			prev[hashed&(windowSize - 1)] = head[h];
+			head[h] = int32_t(hashed);
+			++hashed;
+		}
+	}
+	// Longest match for the sequence at `pos`, returning the length (0 if none)
+	int findMatch(size_t pos, int &distance) {
+		insertUpTo(pos);
+		int available = int(std::min<size_t>(maxMatch, buffer.size() - pos));
+		if (available < minMatch) return 0;
+		int bestLength = 0;
+		const uint8_t *current = buffer.data() + pos;
+		int32_t candidate = head[hashAt(pos)];
+		for (int chain = 0; chain < maxChain && candidate >= 0; ++chain) {
+			int d = int(pos - candidate);
+			if (d > maxDistance) break;
+			const uint8_t *match = buffer.data() + candidate;
+			if (match[bestLength] == current[bestLength]) {
+				int length = 0;
+				while (length < available && match[length] == current[length]) ++length;
+				if (length > bestLength) {
+					bestLength = length;
+					distance = d;
+					if (length >= niceLength || length == available) break;
+				}
+			}
+			candidate = prev[candidate&(windowSize - 1)];
+		}
+		return (bestLength >= minMatch) ? bestLength : 0;
+	}
+
+	void process(bool final, std::vector<uint8_t> &out) {
+		size_t end = buffer.size();
+		// Without more input, matches near the end might be shorter than they could be
+		size_t limit = final ? end : (end > size_t(maxMatch + minMatch) ? end - maxMatch - minMatch : 0);
+		if (level == 0) {
+			processed = std::max(processed, limit);
+			return;
+		}
+		while (processed < limit) {
+			int distance = 0;
+			int length = findMatch(processed, distance);
+			if (length && lazy && length < niceLength) {
+				int nextDistance = 0;
+				if (findMatch(processed + 1, nextDistance) > length) length = 0;
+			}
+			if (length) {
+				symbols.push_back({uint16_t(length), uint16_t(distance)});
+				processed += length;
+			} else {
+				symbols.push_back({buffer[processed], 0});
+				++processed;
+			}
+			if (symbols.size() >= maxSymbols) writeBlock(false, out);
+		}
+	}
+
+	/// Huffman code lengths, limited to `maxBits`
+	static void buildLengths(const uint32_t *frequencies, int count, int maxBits, uint8_t *lengths) {
+		std::vector<uint32_t> freq(frequencies, frequencies + count);
+		int used = 0;
+		for (int i = 0; i < count; ++i) {
+			lengths[i] = 0;
+			if (freq[i]) ++used;
+		}
+		// Decoders want at least two codes
+		for (int i = 0; used < 2 && i < count; ++i) {
+			if (!freq[i]) {
+				freq[i] = 1;
+				++used;
+			}
+		}
+		std::vector<int> parent(count*2);
+		while (true) {
+			typedef std::pair<uint64_t, int> Node; // (weight, index)
+			std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+			for (int i = 0; i < count; ++i) {
+				if (freq[i]) queue.push({freq[i], i});
+			}
+			int next = count;
+			while (queue.size() > 1) {
+				Node a = queue.top();
+				queue.pop();
+				Node b = queue.top();
+				queue.pop();
+				parent[a.second] = parent[b.second] = next;
+				queue.push({a.first + b.first, next++});
+			}
+			int root = next - 1, longest = 0;
+			std::vector<int> depth(next, 0);
+			for (int n = root - 1; n >= count; --n) depth[n] = depth[parent[n]] + 1;
+			for (int i = 0; i < count; ++i) {
+				if (freq[i]) {
+					lengths[i] = depth[parent[i]] + 1;
+					longest = std::max<int>(longest, lengths[i]);
+				}
+			}
+			if (longest <= maxBits) return;
+			// Flatten the distribution and try again
+			for (auto &f : freq) {
+				if (f) f = (f>>1)|1;
+			}
+		}
+	}
+	/// Canonical codes (bit-reversed, since DEFLATE writes Huffman codes MSB-first)
+	static void buildCodes(const uint8_t *lengths, int count, uint16_t *codes) {
+		int lengthCounts[16] = {0}, nextCode[16];
+		for (int i = 0; i < count; ++i) ++lengthCounts[lengths[i]];
+		lengthCounts[0] = 0;
+		int code = 0;
+		for (int bits = 1; bits < 16; ++bits) {
+			code = (code + lengthCounts[bits - 1])<<1;
+			nextCode[bits] = code;
+		}
+		for (int i = 0; i < count; ++i) {
+			int bits = lengths[i];
+			if (!bits) continue;
+			int c = nextCode[bits]++, reversed = 0;
+			for (int b = 0; b < bits; ++b) {
+				reversed = (reversed<<1)|((c>>b)&1);
+			}
+			codes[i] = reversed;
+		}
+	}
+
+	void writeStored(bool final, std::vector<uint8_t> &out) {
+		size_t pos = blockStart, end = processed;
+		do {
+			size_t length = std::min<size_t>(end - pos, 65535);
+			bool last = final && (pos + length == end);
+			putBits(last ? 1 : 0, 3, out);
+			alignToByte(out);
+			out.push_back(length&0xFF);
+			out.push_back(length>>8);
+			out.push_back(~length&0xFF);
+			out.push_back((~length>>8)&0xFF);
+			out.insert(out.end(), buffer.begin() + pos, buffer.begin() + pos + length);
+			pos += length;
+		} while (pos < end);
+	}
+
+	void writeBlock(bool final, std::vector<uint8_t> &out) {
+		auto &t = tables();
+		uint32_t litFreq[286] = {0}, distFreq[distanceCodes] = {0};
+		uint64_t extraBits = 0;
+		for (auto &s : symbols) {
+			if (s.distance) {
+				int lc = t.lengthCode[s.litLen - 3], dc = t.distanceCodeFor(s.distance);
+				++litFreq[257 + lc];
+				++distFreq[dc];
+				extraBits += t.lengthExtra[lc] + t.distanceExtra[dc];
+			} else {
+				++litFreq[s.litLen];
+			}
+		}
+		litFreq[256] = 1; // end-of-block
+
+		// Fixed codes
+		uint8_t fixedLit[288], fixedDist[distanceCodes];
+		for (int i = 0; i < 288; ++i) fixedLit[i] = (i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8;
+		for (int i = 0; i < distanceCodes; ++i) fixedDist[i] = 5;
+		uint64_t fixedBits = 3 + extraBits;
+		for (int i = 0; i < 286; ++i) fixedBits += litFreq[i]*fixedLit[i];
+		for (int i = 0; i < distanceCodes; ++i) fixedBits += distFreq[i]*5;
+
+		// Dynamic codes
+		uint8_t litLengths[286], distLengths[distanceCodes];
+		buildLengths(litFreq, 286, 15, litLengths);
+		buildLengths(distFreq, distanceCodes, 15, distLengths);
+		int litCount = 286, distCount = distanceCodes;
+		while (litCount > 257 && !litLengths[litCount - 1]) --litCount;
+		while (distCount > 1 && !distLengths[distCount - 1]) --distCount;
+		// Run-length encode the code lengths
+		std::vector<uint8_t> all(litLengths, litLengths + litCount);
+		all.insert(all.end(), distLengths, distLengths + distCount);
+		struct Run {
+			uint8_t symbol, extra;
+		};
+		std::vector<Run> runs;
+		uint32_t clFreq[19] = {0};
+		for (size_t i = 0; i < all.size();) {
+			uint8_t v = all[i];
+			size_t repeat = 1;
+			while (i + repeat < all.size() && all[i + repeat] == v) ++repeat;
+			size_t remaining = repeat;
+			if (v == 0) {
+				while (remaining >= 11) {
+					size_t r = std::min<size_t>(remaining, 138);
+					runs.push_back({18, uint8_t(r - 11)});
+					remaining -= r;
+				}
+				if (remaining >= 3) {
+					runs.push_back({17, uint8_t(remaining - 3)});
+					remaining = 0;
+				}
+			} else {
+				runs.push_back({v, 0});
+				--remaining;
+				while (remaining >= 3) {
+					size_t r = std::min<size_t>(remaining, 6);
+					runs.push_back({16, uint8_t(r - 3)});
+					remaining -= r;
+				}
+			}
+			while (remaining--) runs.push_back({v, 0});
+			i += repeat;
+		}
+		for (auto &r : runs) ++clFreq[r.symbol];
+		uint8_t clLengths[19];
+		buildLengths(clFreq, 19, 7, clLengths);
+		static const uint8_t clOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+		int clCount = 19;
+		while (clCount > 4 && !clLengths[clOrder[clCount - 1]]) --clCount;
+		uint64_t dynamicBits = 3 + 14 + 3*clCount + extraBits;
+		for (auto &r : runs) dynamicBits += clLengths[r.symbol] + (r.symbol == 16 ? 2 : r.symbol == 17 ? 3 : r.symbol == 18 ? 7 : 0);
+		for (int i = 0; i < 286; ++i) dynamicBits += litFreq[i]*litLengths[i];
+		for (int i = 0; i < distanceCodes; ++i) dynamicBits += distFreq[i]*distLengths[i];
+
+		size_t blockBytes = processed - blockStart;
+		uint64_t storedBits = (blockBytes + 5*(blockBytes/65535 + 1))*8 + 8;
+		if (level == 0 || (storedBits <= fixedBits && storedBits <= dynamicBits)) {
+			writeStored(final, out);
+		} else {
+			const uint8_t *lit = litLengths, *dist = distLengths;
+			if (fixedBits <= dynamicBits) {
+				putBits(final ? 3 : 2, 3, out);
+				lit = fixedLit;
+				dist = fixedDist;
+			} else {
+				putBits(final ? 5 : 4, 3, out);
+				putBits(litCount - 257, 5, out);
+				putBits(distCount - 1, 5, out);
+				putBits(clCount - 4, 4, out);
+				for (int i = 0; i < clCount; ++i) putBits(clLengths[clOrder[i]], 3, out);
+				uint16_t clCodes[19];
+				buildCodes(clLengths, 19, clCodes);
+				for (auto &r : runs) {
+					putBits(clCodes[r.symbol], clLengths[r.symbol], out);
+					if (r.symbol == 16) putBits(r.extra, 2, out);
+					if (r.symbol == 17) putBits(r.extra, 3, out);
+					if (r.symbol == 18) putBits(r.extra, 7, out);
+				}
+			}
+			uint16_t litCodes[288], distCodes[distanceCodes];
+			buildCodes(lit, (lit == fixedLit) ? 288 : 286, litCodes);
+			buildCodes(dist, distanceCodes, distCodes);
+			for (auto &s : symbols) {
+				if (s.distance) {
+					int lc = t.lengthCode[s.litLen - 3], dc = t.distanceCodeFor(s.distance);
+					putBits(litCodes[257 + lc], lit[257 + lc], out);
+					putBits(s.litLen - t.lengthBase[lc], t.lengthExtra[lc], out);
+					putBits(distCodes[dc], dist[dc], out);
+					putBits(s.distance - t.distanceBase[dc], t.distanceExtra[dc], out);
+				} else {
+					putBits(litCodes[s.litLen], lit[s.litLen], out);
+				}
+			}
+			putBits(litCodes[256], lit[256], out);
+		}
+		symbols.clear();
+		blockStart = processed;
+	}
+
+	// Drop the oldest half of the buffer, keeping enough history for matching
+	void slide(std::vector<uint8_t> &out) {
+		if (blockStart < processed) writeBlock(false, out);
+		buffer.erase(buffer.begin(), buffer.begin() + windowSize);
+		processed -= windowSize;
+		hashed -= windowSize;
+		blockStart -= windowSize;
+		for (auto &h : head) h = (h >= windowSize) ? h - windowSize : -1;
+		for (auto &p : prev) p = (p >= windowSize) ? p - windowSize : -1;
+	}
+public:
+	Deflate(int level=6) : level(std::max(0, std::min(9, level))), head(1<<hashBits, -1), prev(windowSize, -1) {
+		static const int chains[10] = {0, 4, 8, 16, 32, 64, 128, 256, 1024, 4096};
+		static const int nice[10] = {0, 16, 32, 64, 64, 128, 128, 258, 258, 258};
+		maxChain = chains[this->level];
+		niceLength = nice[this->level];
+		lazy = (this->level >= 4);
+		buffer.reserve(windowSize*2);
+	}
+
+	/// Compresses some input, appending any complete output to `out`
+	void write(const uint8_t *data, size_t length, std::vector<uint8_t> &out) {
+		while (length > 0) {
+			if (buffer.size() == size_t(windowSize*2)) slide(out);
+			size_t chunk = std::min(length, windowSize*2 - buffer.size());
+			buffer.insert(buffer.end(), data, data + chunk);
+			data += chunk;
+			length -= chunk;
+			process(false, out);
+		}
+	}
+	/// Compresses any remaining input, ending with a final block (byte-aligned)
+	void finish(std::vector<uint8_t> &out) {
+		process(true, out);
+		writeBlock(true, out);
+		alignToByte(out);
+	}
+};
+
+/// Compresses output in gzip format (e.g. for `.svgz` files) before passing it on to another sink
+class GzipSink : public OutputSink {
+	OutputSink &output;
+	Deflate deflate;
+	Crc32 crc;
+	uint32_t inputSize = 0;
+	std::vector<uint8_t> compressed;
+	bool finished = false;
+
+	void pass(bool force) {
+		if (compressed.size() >= 65536 || (force && compressed.size())) {
+			output.write((const char *)compressed.data(), compressed.size());
+			compressed.clear();
+		}
+	}
+public:
+	GzipSink(OutputSink &output, int level=6) : output(output), deflate(level) {
+		// magic, DEFLATE, no flags, no timestamp, compression hint, unknown OS
+		const uint8_t header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, uint8_t(level >= 9 ? 2 : level <= 1 ? 4 : 0), 255};
+		compressed.assign(header, header + 10);
+	}
+	~GzipSink() {
+		flush();
+	}
+	GzipSink(const GzipSink &other) = delete;
+
+	void write(const char *data, size_t length) override {
+		if (finished) return;
+		crc.add((const uint8_t *)data, length);
+		inputSize += length;
+		deflate.write((const uint8_t *)data, length, compressed);
+		pass(false);
+	}
+	/// Completes the gzip stream - anything written afterwards is ignored
+	void flush() override {
+		if (!finished) {
+			deflate.finish(compressed);
+			uint32_t trailer[2] = {crc.result(), inputSize};
+			for (auto v : trailer) {
+				for (int i = 0; i < 4; ++i) compressed.push_back((v>>(i*8))&0xFF);
+			}
+			finished = true;
+		}
+		pass(true);
+		output.flush();
+	}
+	bool good() const override {
+		return output.good();
+	}
+};
+
 /// Wrapper for slightly more semantic code when writing SVGs
 class SvgWriter {
-	std::ostream &output;
+	std::unique_ptr<StreamSink> streamSink; // only used when writing to a `std::ostream`
+	OutputSink &output;
+	char buffer[16384];
+	size_t bufferUsed = 0;
+
 	std::vector<Bounds> clipStack;
 	long idCounter = 0;
+	std::string idScope;
 	double precision, invPrecision;
+	DecimalFormat format;
+
+	// Clip stacks are recycled (per thread), so writing doesn't allocate once it's warmed up
+	static std::vector<std::vector<Bounds>> & spareClipStacks() {
+		static thread_local std::vector<std::vector<Bounds>> spare;
+		return spare;
+	}
+	static std::vector<Bounds> takeClipStack(Bounds bounds) {
+		auto &spare = spareClipStacks();
+		std::vector<Bounds> stack;
+		if (spare.size()) {
+			stack.swap(spare.back());
+			spare.pop_back();
+		}
+		stack.assign(1, bounds);
+		return stack;
+	}
+
+	void put(const char *data, size_t length) {
+		if (bufferUsed + length > sizeof(buffer)) {
+			flush();
+			if (length > sizeof(buffer)) return output.write(data, length);
+		}
+		std::memcpy(buffer + bufferUsed, data, length);
+		bufferUsed += length;
+	}
+
+	void rawValue(double v) {
+		char digits[DecimalFormat::maxLength];
+		int length = format.write(v, digits);
+		if (length) {
+			put(digits, length);
+		} else {
+			rawFallback(v);
+		}
+	}
+	void rawValue(float v) {
+		rawValue(double(v));
+	}
+	void rawValue(const char *str) {
+		put(str, std::strlen(str));
+	}
+	void rawValue(const std::string &str) {
+		put(str.data(), str.size());
+	}
+	void rawValue(char c) {
+		put(&c, 1);
+	}
+	template<class V>
+	void rawValue(const V &v) {
+		// Character types are written as characters (like `std::ostream` does), not numbers
+		using IsNumber = std::integral_constant<bool, std::is_integral<V>::value && !std::is_same<V, signed char>::value && !std::is_same<V, unsigned char>::value>;
+		rawOther(v, IsNumber());
+	}
+	void rawOther(long long v, std::true_type) {
+		char digits[DecimalFormat::maxLength];
+		put(digits, DecimalFormat::writeFixed(v, 0, digits));
+	}
+	template<class V>
+	void rawOther(const V &v, std::false_type) {
+		rawFallback(v);
+	}
+	void writeValue(const char *str) {
+		// Copy unescaped spans in bulk
+		while (*str) {
+			size_t span = std::strcspn(str, "<&\"");
+			put(str, span);
+			str += span;
+			if (*str == '<') {
+				put("&lt;", 4);
+			} else if (*str == '&') {
+				put("&amp;", 5);
+			} else if (*str == '"') {
+				put("&quot;", 6);
+			} else {
+				break;
+			}
+			++str;
+		}
+	}
+	void writeValue(const std::string &str) {
+		writeValue(str.c_str());
+	}
+	template<class V>
+	void writeValue(const V &v) {
+		rawValue(v);
+	}
+	template<class V>
+	void rawFallback(const V &v) {
+		std::ostringstream stream;
+		stream << v;
+		rawValue(stream.str());
+	}
 public:
-	SvgWriter(std::ostream &output, Bounds bounds, double precision) : output(output), clipStack({bounds}), precision(precision), invPrecision(1.0/precision) {}
+	SvgWriter(OutputSink &output, Bounds bounds, double precision) : output(output), clipStack(takeClipStack(bounds)), precision(precision), invPrecision(1.0/precision), format(precision), simplifyTolerance(invPrecision) {
+		takeScratch();
+	}
+	SvgWriter(std::ostream &stream, Bounds bounds, double precision) : streamSink(new StreamSink(stream)), output(*streamSink), clipStack(takeClipStack(bounds)), precision(precision), invPrecision(1.0/precision), format(precision), simplifyTolerance(invPrecision) {
+		takeScratch();
+	}
+	~SvgWriter() {
+		flush();
+		clipStack.clear();
+		spareClipStacks().push_back(std::move(clipStack));
+		spareScratch().push_back(std::move(scratch));
+	}
+	/** A writer with the same settings and current clipping bounds, for writing a section of the document separately (e.g. on another thread).
+		If it might use `.elementId()`, it needs a unique `idScope`. */
+	SvgWriter(OutputSink &output, const SvgWriter &settings, const std::string &idScope="") : output(output), clipStack(takeClipStack(settings.clipStack.back())), idScope(settings.idScope + idScope), precision(settings.precision), invPrecision(settings.invPrecision), format(settings.precision), simplifyTolerance(settings.simplifyTolerance) {
+		animated = settings.animated;
+		compactPaths = settings.compactPaths;
+		simplify = settings.simplify;
+		takeScratch();
+	}
+	SvgWriter(const SvgWriter &other) = delete;
+
+	/// Adds the settings which affect written paths (including the current clipping bounds) to a cache key
+	void cacheKey(CacheKey &key) const {
+		const Bounds &clip = clipStack.back();
+		key.add(clip.left).add(clip.right).add(clip.top).add(clip.bottom).add(clip.set);
+		key.add(precision).add(animated).add(compactPaths).add(simplify).add(simplifyTolerance);
+	}
+
+	/// Passes any buffered output on to the sink
+	SvgWriter & flush() {
+		if (bufferUsed) output.write(buffer, bufferUsed);
+		bufferUsed = 0;
+		return *this;
+	}
 	
 	SvgWriter & raw() {
 		return *this;
 	}
+	/// Numbers (`double`) are rounded to the writer's precision
 	template<class First, class ...Args>
 	SvgWriter & raw(First &&first, Args &&...args) {
-		output << first;
+		rawValue(first);
 		return raw(args...);
 	}
+	SvgWriter & rawBytes(const char *data, size_t length) {
+		put(data, length);
+		return *this;
+	}
+	/// Writes a number with a specific precision, e.g. for times which need more than the coordinate precision
+	SvgWriter & number(double v, double numberPrecision) {
+		char digits[DecimalFormat::maxLength];
+		int length = DecimalFormat(numberPrecision).write(v, digits);
+		if (length) {
+			put(digits, length);
+		} else {
+			rawFallback(v);
+		}
+		return *this;
+	}
 
 	SvgWriter & write() {
 		return *this;
 	}
+	/// Strings are escaped, other values are written the same as `.raw()`
 	template<class First, class ...Args>
-	SvgWriter & write(First &&v, Args &&...args) {
-		// Only strings get escaped
-		return raw(v).write(args...);
-	}
-	template<class ...Args>
-	SvgWriter & write(const char *str, Args &&...args) {
-		while (*str) {
-			if (*str == '<') {
-				output << "&lt;";
-			} else if (*str == '&') {
-				output << "&amp;";
-			} else if (*str == '"') {
-				output << "&quot;";
-			} else {
-				output << (*str);
-			}
-			++str;
-		}
+	SvgWriter & write(First &&first, Args &&...args) {
+		writeValue(first);
 		return write(args...);
 	}
-	template<class ...Args>
-	SvgWriter & write(std::string str, Args &&...args) {
-		return write(str.c_str(), args...);
-	}
 	
 	template<class ...Args>
 	SvgWriter & attr(const char *name, Args &&...args) {
@@ -341,8 +1697,8 @@ public:
 		return raw("</g>");
 	}
 	
-	std::string elementId(std::string prefix) {
-		return prefix + std::to_string(idCounter++);
+	std::string elementId(const std::string &prefix) {
+		return prefix + idScope + std::to_string(idCounter++);
 	}
 	
 	/// XML tag helper, closing the tag when it's destroyed
@@ -383,76 +1739,639 @@ public:
 	}
 
 	double round(double v) {
-		return std::round(v*precision)*invPrecision;
+		return format.round(v);
 	};
 
 	bool animated = false;
-	enum class PointState {start, outOfBounds, singlePoint, pendingLine};
-	PointState pointState = PointState::start;
-	char outOfBoundsMask = 0; // tracks which direction(s) we are out of bounds
-	Point2D lastDrawn, prevPoint;
-	double totalPendingError = 0;
-	void startPath() {
+	/// Number of threads to use for `SvgDrawable::writeData()`
+	int threads = 1;
+	/// Paths use relative `l` commands with integer steps on the precision grid, dropping unneeded zeros/separators
+	bool compactPaths = false;
+	/// Simplification for paths, and the maximum distance (in SVG units) it can move a line
+	PlotStyle::Simplify simplify = PlotStyle::Simplify::streaming;
+	double simplifyTolerance;
+
+	/** Starts a path, clipped to the current bounds (see `.pushClip()`).
+		Lines are split into separate sub-paths where they leave the bounds, and fills are clipped as a polygon. */
+	void startPath(bool fill=false) {
+		pathIsFill = fill;
+		pathTolerance = simplifyTolerance;
 		pointState = PointState::start;
-		outOfBoundsMask = 0;
-		prevPoint.x = prevPoint.y = -1e300;
-		raw("M");
+		clipStarted = clipConnected = false;
+		clipPrevCode = 0;
+		for (auto &stage : clipStages) stage.started = false;
+		pathPoints = 0;
+		scratch.pendingPath.clear();
 	}
 	void endPath() {
+		if (scratch.pendingPath.size()) {
+			if (simplify == PlotStyle::Simplify::visvalingam) {
+				simplifyVisvalingam(scratch.pendingPath, simplifyTolerance);
+			}
+			simplifyDouglasPeucker(scratch.pendingPath, simplifyTolerance);
+			// The points are already simplified, so only drop exactly-straight lines
+			pathTolerance = 0;
+			for (auto &p : scratch.pendingPath) {
+				if (p.keep) clipPoint(p.point, clipCode(p.point), p.alwaysInclude);
+			}
+			scratch.pendingPath.clear();
+		}
+		if (pathIsFill) closeClipPolygon(0);
 		if (pointState == PointState::pendingLine) {
-			raw(" ", round(prevPoint.x), " ", round(prevPoint.y));
+			drawPoint(prevPoint);
 		}
 	}
+	/// Points with `alwaysInclude` are never clipped, so that animated paths keep the same structure
 	void addPoint(double x, double y, bool alwaysInclude=false) {
 		if (std::isnan(x) || std::isnan(y)) return;
-		auto clip = clipStack.back();
-		/// Bitmask indicating which direction(s) the point is outside the bounds
-		char mask = (clip.left > x)
-			| (2*(clip.right < x))
-			| (4*(clip.top > y))
-			| (8*(clip.bottom < y));
-		if (alwaysInclude) mask = 0;
-		outOfBoundsMask &= mask;
-		if (!outOfBoundsMask) {
-			if (pointState == PointState::outOfBounds) {
-				// Draw the most recent out-of-bounds point
-				raw(" ", round(prevPoint.x), " ", round(prevPoint.y));
-				lastDrawn = prevPoint;
-				pointState = PointState::singlePoint;
+		if (simplify == PlotStyle::Simplify::streaming) {
+			Point2D p{x, y};
+			int code = clipCode(p);
+			if ((code&clipPrevCode) && !alwaysInclude) {
+				// Quick path for consecutive points outside the same edge
+				if (!pathIsFill) {
+					clipPrev = p;
+					clipPrevCode = code;
+					clipConnected = false;
+					return;
+				} else if (code&clipPrevCode&1) {
+					clipStages[0].prev = p;
+					clipPrevCode = code;
+					return;
+				}
 			}
-			if (pointState == PointState::singlePoint) {
-				pointState = PointState::pendingLine;
-				totalPendingError = 0;
-			} else if (pointState == PointState::pendingLine) {
-				// Approximate the pending point as being on the line from last-drawn point -> current
-				double d1 = std::hypot(prevPoint.x - lastDrawn.x, prevPoint.y - lastDrawn.y);
-				double d2 = std::hypot(x - lastDrawn.x, y - lastDrawn.y);
-				double scale = d2 ? d1/d2 : 0;
-				double extX = lastDrawn.x + (x - lastDrawn.x)*scale;
-				double extY = lastDrawn.y + (y - lastDrawn.y)*scale;
-				// How far off would that be?
-				totalPendingError += std::hypot(extX - prevPoint.x, extY - prevPoint.y);
-				if (totalPendingError > invPrecision) {
-					// Would be too much accumulated error.  Draw the pending segment, and start a new one.
-					raw(" ", round(prevPoint.x), " ", round(prevPoint.y));
-					lastDrawn = prevPoint;
-					totalPendingError = 0;
+			clipPoint(p, code, alwaysInclude);
+		} else {
+			// Collect the whole path, and simplify in `.endPath()`
+			scratch.pendingPath.push_back({{x, y}, alwaysInclude, alwaysInclude});
+		}
+	}
+private:
+	bool pathIsFill = false;
+	double pathTolerance = 0;
+	enum class PointState {start, singlePoint, pendingLine};
+	PointState pointState = PointState::start;
+	Point2D lastDrawn, prevPoint;
+	double totalPendingError = 0;
+
+	// Line clipping: the previous input point, and whether it was the last point passed on
+	bool clipStarted = false, clipConnected = false;
+	Point2D clipPrev;
+	int clipPrevCode = 0;
+	// Polygon clipping: one Sutherland-Hodgman stage for each edge (left, right, top, bottom)
+	struct ClipStage {
+		bool started = false;
+		Point2D first, prev;
+		bool firstForced, prevForced, prevInside;
+	};
+	ClipStage clipStages[4];
+
+	/// Bitmask indicating which edge(s) of the bounds the point is outside, in the same order as `clipStages`
+	int clipCode(Point2D p) {
+		auto &clip = clipStack.back();
+		return (clip.left > p.x)
+			| (2*(clip.right < p.x))
+			| (4*(clip.top > p.y))
+			| (8*(clip.bottom < p.y));
+	}
+
+	void clipPoint(Point2D p, int code, bool alwaysInclude) {
+		int prevCode = clipPrevCode;
+		clipPrevCode = alwaysInclude ? 0 : code;
+		if (pathIsFill) return clipPolygonPoint(0, p, code, alwaysInclude);
+		auto &clip = clipStack.back();
+		if (alwaysInclude) {
+			simplifyPoint(p, !clipStarted);
+			clipConnected = true;
+		} else if (!clipStarted) {
+			clipConnected = !code;
+			if (clipConnected) simplifyPoint(p, true);
+		} else if (!(code | prevCode)) {
+			// Both inside
+			simplifyPoint(p, !clipConnected);
+			clipConnected = true;
+		} else if (code & prevCode) {
+			// Both outside the same edge
+			clipConnected = false;
+		} else {
+			// Liang-Barsky: find the visible section (t0 -> t1) of the segment
+			Point2D a = clipPrev;
+			double dx = p.x - a.x, dy = p.y - a.y;
+			double t0 = 0, t1 = 1;
+			auto edge = [&](double step, double distance) {
+				if (step == 0) return distance >= 0;
+				double t = distance/step;
+				if (step < 0) {
+					if (t > t1) return false;
+					t0 = std::max(t0, t);
+				} else {
+					if (t < t0) return false;
+					t1 = std::min(t1, t);
 				}
-			} else { // start
-				raw(" ", round(x), " ", round(y));
-				lastDrawn = {x, y};
-				pointState = PointState::singlePoint;
-			}
-			outOfBoundsMask = mask;
-			if (outOfBoundsMask && pointState != PointState::start) {
-				if (pointState == PointState::pendingLine) {
-					raw(" ", round(prevPoint.x), " ", round(prevPoint.y));
+				return true;
+			};
+			if (edge(-dx, a.x - clip.left) && edge(dx, clip.right - a.x) && edge(-dy, a.y - clip.top) && edge(dy, clip.bottom - a.y)) {
+				if (t0 > 0 || !clipConnected) {
+					// Entering the bounds, so start a new sub-path (unless the previous point was unclipped)
+					simplifyPoint({a.x + dx*t0, a.y + dy*t0}, !clipConnected);
 				}
-				raw(" ", round(x), " ", round(y)); // Draw the first out-of-bounds point
-				pointState = PointState::outOfBounds;
+				if (t1 < 1) {
+					simplifyPoint({a.x + dx*t1, a.y + dy*t1}, false);
+					clipConnected = false;
+				} else {
+					simplifyPoint(p, false);
+					clipConnected = true;
+				}
+			} else {
+				clipConnected = false;
 			}
 		}
-		prevPoint = {x, y};
+		clipPrev = p;
+		clipStarted = true;
+	}
+
+	Point2D clipEdgeIntersection(int edge, Point2D a, Point2D b) {
+		auto &clip = clipStack.back();
+		if (edge < 2) {
+			double x = (edge == 0) ? clip.left : clip.right;
+			return {x, a.y + (b.y - a.y)*(x - a.x)/(b.x - a.x)};
+		} else {
+			double y = (edge == 2) ? clip.top : clip.bottom;
+			return {a.x + (b.x - a.x)*(y - a.y)/(b.y - a.y), y};
+		}
+	}
+	void clipPolygonPoint(int edge, Point2D p, int code, bool forced) {
+		if (edge == 4) return simplifyPoint(p, false);
+		auto &stage = clipStages[edge];
+		bool inside = forced || !(code&(1<<edge));
+		if (!stage.started) {
+			stage.started = true;
+			stage.first = p;
+			stage.firstForced = forced;
+		} else if (inside != stage.prevInside && !forced && !stage.prevForced) {
+			Point2D i = clipEdgeIntersection(edge, stage.prev, p);
+			clipPolygonPoint(edge + 1, i, clipCode(i), false);
+		}
+		if (inside) clipPolygonPoint(edge + 1, p, code, forced);
+		stage.prev = p;
+		stage.prevForced = forced;
+		stage.prevInside = inside;
+	}
+	void closeClipPolygon(int edge) {
+		if (edge == 4) return;
+		auto &stage = clipStages[edge];
+		if (stage.started) {
+			bool inside = stage.firstForced || !(clipCode(stage.first)&(1<<edge));
+			if (inside != stage.prevInside && !stage.firstForced && !stage.prevForced) {
+				Point2D i = clipEdgeIntersection(edge, stage.prev, stage.first);
+				clipPolygonPoint(edge + 1, i, clipCode(i), false);
+			}
+		}
+		closeClipPolygon(edge + 1);
+	}
+
+	/// Streaming simplification: extends the pending line until the accumulated error is above `pathTolerance`
+	void simplifyPoint(Point2D p, bool move) {
+		if (move && pointState != PointState::start) {
+			if (pointState == PointState::pendingLine) drawPoint(prevPoint);
+			pointState = PointState::start;
+		}
+		if (pointState == PointState::singlePoint) {
+			pointState = PointState::pendingLine;
+			totalPendingError = 0;
+		} else if (pointState == PointState::pendingLine) {
+			// Approximate the pending point as being on the line from last-drawn point -> current
+			double d1 = std::hypot(prevPoint.x - lastDrawn.x, prevPoint.y - lastDrawn.y);
+			double d2 = std::hypot(p.x - lastDrawn.x, p.y - lastDrawn.y);
+			double scale = d2 ? d1/d2 : 0;
+			double extX = lastDrawn.x + (p.x - lastDrawn.x)*scale;
+			double extY = lastDrawn.y + (p.y - lastDrawn.y)*scale;
+			// How far off would that be?
+			totalPendingError += std::hypot(extX - prevPoint.x, extY - prevPoint.y);
+			if (totalPendingError > pathTolerance) {
+				// Would be too much accumulated error.  Draw the pending segment, and start a new one.
+				drawPoint(prevPoint);
+				lastDrawn = prevPoint;
+				totalPendingError = 0;
+			}
+		} else { // start
+			drawPoint(p, true);
+			lastDrawn = p;
+			pointState = PointState::singlePoint;
+		}
+		prevPoint = p;
+	}
+	struct PathPoint {
+		Point2D point;
+		bool alwaysInclude, keep;
+	};
+	// Working space for the whole-path simplification, recycled (per thread) like the clip stacks
+	struct VisvalingamEntry {
+		double area;
+		size_t index, version;
+		bool operator<(const VisvalingamEntry &other) const {
+			return area > other.area; // smallest area first
+		}
+	};
+	struct Scratch {
+		std::vector<PathPoint> pendingPath;
+		std::vector<std::pair<size_t, size_t>> spans;
+		std::vector<size_t> prev, next, version;
+		std::vector<VisvalingamEntry> queue; // heap
+	};
+	Scratch scratch;
+	static std::vector<Scratch> & spareScratch() {
+		static thread_local std::vector<Scratch> spare;
+		return spare;
+	}
+	void takeScratch() {
+		auto &spare = spareScratch();
+		if (spare.size()) {
+			std::swap(scratch, spare.back());
+			spare.pop_back();
+		}
+	}
+
+	static double segmentDistance(Point2D p, Point2D a, Point2D b) {
+		double dx = b.x - a.x, dy = b.y - a.y;
+		double length2 = dx*dx + dy*dy;
+		double t = length2 ? ((p.x - a.x)*dx + (p.y - a.y)*dy)/length2 : 0;
+		t = std::max(0.0, std::min(1.0, t));
+		return std::hypot(a.x + dx*t - p.x, a.y + dy*t - p.y);
+	}
+	/// Ramer-Douglas-Peucker: adds points to each span between existing `.keep` points, until it's within tolerance
+	void simplifyDouglasPeucker(std::vector<PathPoint> &points, double tolerance) {
+		points[0].keep = points.back().keep = true;
+		auto &spans = scratch.spans;
+		spans.clear();
+		size_t start = 0;
+		for (size_t i = 1; i < points.size(); ++i) {
+			if (points[i].keep) {
+				if (i > start + 1) spans.push_back({start, i});
+				start = i;
+			}
+		}
+		while (spans.size()) {
+			auto span = spans.back();
+			spans.pop_back();
+			Point2D a = points[span.first].point, b = points[span.second].point;
+			size_t furthest = 0;
+			double furthestDistance = tolerance;
+			for (size_t i = span.first + 1; i < span.second; ++i) {
+				double distance = segmentDistance(points[i].point, a, b);
+				if (distance > furthestDistance) {
+					furthest = i;
+					furthestDistance = distance;
+				}
+			}
+			if (furthest) {
+				points[furthest].keep = true;
+				if (furthest > span.first + 1) spans.push_back({span.first, furthest});
+				if (span.second > furthest + 1) spans.push_back({furthest, span.second});
+			}
+		}
+	}
+	/** Visvalingam-Whyatt: removes points in order of their triangle's area, until the smallest is above `tolerance^2`.
+		This doesn't bound the distance, so the result is checked/fixed with `simplifyDouglasPeucker()`. */
+	void simplifyVisvalingam(std::vector<PathPoint> &points, double tolerance) {
+		size_t n = points.size();
+		for (auto &p : points) p.keep = true;
+		if (n < 3) return;
+		auto &prev = scratch.prev, &next = scratch.next, &version = scratch.version;
+		prev.resize(n);
+		next.resize(n);
+		version.assign(n, 0);
+		for (size_t i = 0; i < n; ++i) {
+			prev[i] = i - 1;
+			next[i] = i + 1;
+		}
+		auto area = [&](size_t i) {
+			Point2D a = points[prev[i]].point, b = points[i].point, c = points[next[i]].point;
+			return std::abs((b.x - a.x)*(c.y - a.y) - (c.x - a.x)*(b.y - a.y))*0.5;
+		};
+		double areaLimit = tolerance*tolerance;
+		// A `std::vector` heap rather than `std::priority_queue`, so the storage can be reused
+		auto &queue = scratch.queue;
+		queue.clear();
+		for (size_t i = 1; i + 1 < n; ++i) {
+			if (!points[i].alwaysInclude) queue.push_back({area(i), i, 0});
+		}
+		std::make_heap(queue.begin(), queue.end());
+		while (queue.size()) {
+			std::pop_heap(queue.begin(), queue.end());
+			VisvalingamEntry e = queue.back();
+			queue.pop_back();
+			size_t i = e.index;
+			if (!points[i].keep || e.version != version[i]) continue;
+			if (e.area > areaLimit) break;
+			points[i].keep = false;
+			size_t p = prev[i], nx = next[i];
+			next[p] = nx;
+			prev[nx] = p;
+			for (size_t neighbour : {p, nx}) {
+				if (neighbour == 0 || neighbour == n - 1 || points[neighbour].alwaysInclude) continue;
+				queue.push_back({area(neighbour), neighbour, ++version[neighbour]});
+				std::push_heap(queue.begin(), queue.end());
+			}
+		}
+	}
+
+	// Compact path state, in units of the precision grid
+	long long pathX = 0, pathY = 0;
+	int pathPoints = 0;
+	bool pathNumberHasDot = false;
+	void pathNumber(long long grid, bool afterCommand) {
+		char digits[DecimalFormat::maxLength];
+		int length = format.write(grid*invPrecision, digits);
+		if (!length) {
+			std::ostringstream stream;
+			stream << grid*invPrecision;
+			std::string str = stream.str();
+			if (!afterCommand) put(" ", 1);
+			put(str.data(), str.size());
+			// A following ".5" only skips its separator after a plain decimal with a "." (not "1e+20" or "1.5e+20")
+			pathNumberHasDot = str.find('.') != std::string::npos && str.find_first_of("eE") == std::string::npos;
+			return;
+		}
+		const char *start = digits;
+		// "0.5" -> ".5", "-0.5" -> "-.5"
+		if (length > 1 && digits[0] == '0' && digits[1] == '.') {
+			++start;
+			--length;
+		} else if (length > 2 && digits[0] == '-' && digits[1] == '0' && digits[2] == '.') {
+			digits[1] = '-';
+			++start;
+			--length;
+		}
+		bool hasDot = std::memchr(start, '.', length) != nullptr;
+		// Separators are only needed if the number could otherwise continue the previous one
+		bool needsSeparator = !afterCommand && start[0] != '-' && !(start[0] == '.' && pathNumberHasDot);
+		if (needsSeparator) put(" ", 1);
+		put(start, length);
+		pathNumberHasDot = hasDot;
+	}
+	/// Position on the precision grid, clamped so that it (and the difference between two of them) can be written by `DecimalFormat`
+	long long pathGrid(double v) const {
+		static constexpr double limit = 1e14;
+		double scaled = v*precision;
+		return std::llround(scaled < -limit ? -limit : scaled > limit ? limit : scaled);
+	}
+	bool pathLineCommand = false;
+	/// Writes a point, or starts a new sub-path if `move` is set.  The initial "M" is only written once there's a point.
+	void drawPoint(Point2D p, bool move=false) {
+		if (!compactPaths) {
+			if (!pathPoints) {
+				put("M", 1);
+			} else if (move) {
+				put(" M", 2);
+			}
+			raw(" ", round(p.x), " ", round(p.y));
+			++pathPoints;
+			return;
+		}
+		if (std::isnan(p.x) || std::isnan(p.y)) return;
+		long long gridX = pathGrid(p.x), gridY = pathGrid(p.y);
+		if (pathPoints == 0) {
+			put("M", 1);
+			pathNumber(gridX, true);
+			pathNumber(gridY, false);
+			pathLineCommand = true;
+		} else {
+			// Relative "m" is followed by implicit relative line-to, so only "M" needs an "l" afterwards
+			bool afterCommand = false;
+			if (move) {
+				put("m", 1);
+				afterCommand = true;
+				pathLineCommand = false;
+			} else if (pathLineCommand) {
+				put("l", 1);
+				afterCommand = true;
+				pathLineCommand = false;
+			}
+			pathNumber(gridX - pathX, afterCommand);
+			pathNumber(gridY - pathY, false);
+		}
+		pathX = gridX;
+		pathY = gridY;
+		++pathPoints;
+	}
+};
+
+/// Set while a `parallelFor()` is using multiple threads, so nested ones run single-threaded
+static bool & parallelForActive() {
+	static thread_local bool active = false;
+	return active;
+}
+/** Persistent helper threads for `parallelFor()`, so it doesn't start new threads for every layout/write.
+	Threads are added as needed (up to the most ever requested at once), and wait for work in between.
+*/
+class WorkerPool {
+public:
+	struct Task {
+		virtual ~Task() {}
+		virtual void run() = 0;
+	};
+
+	static WorkerPool & shared() {
+		static WorkerPool pool;
+		return pool;
+	}
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		for (auto &thread : threads) thread.join();
+	}
+
+	/// Queues `task.run()` to be called from `count` separate threads
+	void start(Task &task, int count) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while (threads.size() < size_t(count)) {
+				threads.emplace_back([this]() {work();});
+			}
+			for (int i = 0; i < count; ++i) queue.push_back(&task);
+		}
+		condition.notify_all();
+	}
+	/// Removes any queued calls for the task which haven't started yet, returning how many
+	int cancel(Task &task) {
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t size = queue.size();
+		queue.erase(std::remove(queue.begin(), queue.end(), &task), queue.end());
+		return int(size - queue.size());
+	}
+private:
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::vector<std::thread> threads;
+	std::deque<Task *> queue;
+	bool stopping = false;
+
+	void work() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			condition.wait(lock, [&]() {
+				return stopping || !queue.empty();
+			});
+			if (queue.empty()) return;
+			Task *task = queue.front();
+			queue.pop_front();
+			lock.unlock();
+			task->run();
+			lock.lock();
+		}
+	}
+};
+
+/** Calls `fn(index)` for each index, spread across (up to) `threads` threads including the current one.
+	If any call throws, the remaining indices are skipped and the (first) exception is rethrown here. */
+template<class Fn>
+static void parallelFor(size_t count, int threads, Fn &&fn) {
+	if (threads <= 1 || count <= 1 || parallelForActive()) {
+		for (size_t index = 0; index < count; ++index) fn(index);
+		return;
+	}
+	struct Work : public WorkerPool::Task {
+		Fn &fn;
+		size_t count;
+		std::atomic<size_t> next{0};
+		std::mutex mutex;
+		std::condition_variable doneCondition;
+		int running = 0; // helper calls which haven't finished
+		std::exception_ptr error;
+
+		Work(Fn &fn, size_t count) : fn(fn), count(count) {}
+
+		void work() {
+			bool wasActive = parallelForActive();
+			parallelForActive() = true;
+			try {
+				size_t index;
+				while ((index = next++) < count) fn(index);
+			} catch (...) {
+				next = count;
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!error) error = std::current_exception();
+			}
+			parallelForActive() = wasActive;
+		}
+		void run() override {
+			work();
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--running == 0) doneCondition.notify_all();
+		}
+	} work(fn, count);
+
+	auto &pool = WorkerPool::shared();
+	int helpers = int(std::min<size_t>(threads, count)) - 1;
+	work.running = helpers;
+	pool.start(work, helpers);
+	work.work();
+	// Don't wait for helpers which haven't started
+	int cancelled = pool.cancel(work);
+	{
+		std::unique_lock<std::mutex> lock(work.mutex);
+		work.running -= cancelled;
+		work.doneCondition.wait(lock, [&]() {
+			return work.running == 0;
+		});
+	}
+	if (work.error) std::rethrow_exception(work.error);
+}
+
+/** Block allocator for a tree of drawables.
+
+	Elements created by a drawable (lines, labels, plots, grid cells etc.) come from its arena, which they share, so they're packed into a few large blocks.  Freed elements are re-used for later ones of the same size (e.g. tick labels, which are re-created for each layout), and the blocks are freed together once the last element using the arena is gone.
+*/
+class DrawableArena {
+	static constexpr size_t align = alignof(std::max_align_t);
+	static constexpr size_t maxPooled = 4096, blockSize = 65536;
+	struct Header {
+		DrawableArena *arena;
+		size_t size;
+	};
+	static constexpr size_t headerSize = (sizeof(Header) + align - 1)/align*align;
+	struct FreeNode {
+		FreeNode *next;
+	};
+
+	std::mutex mutex; // only contended if separate grid cells are laid out in parallel
+	std::atomic<size_t> refs{0};
+	std::vector<char *> blocks;
+	char *blockNext = nullptr;
+	size_t blockRemaining = 0;
+	FreeNode *freeLists[maxPooled/align] = {};
+
+	DrawableArena() {}
+	~DrawableArena() {
+		for (auto *block : blocks) ::operator delete(block);
+	}
+
+	void * take(size_t size) {
+		std::lock_guard<std::mutex> lock(mutex);
+		FreeNode *&freeList = freeLists[size/align - 1];
+		if (freeList) {
+			FreeNode *node = freeList;
+			freeList = node->next;
+			return node;
+		}
+		if (size > blockRemaining) {
+			blockNext = (char *)::operator new(blockSize);
+			blocks.push_back(blockNext);
+			blockRemaining = blockSize;
+		}
+		void *result = blockNext;
+		blockNext += size;
+		blockRemaining -= size;
+		return result;
+	}
+	void give(void *ptr, size_t size) {
+		std::lock_guard<std::mutex> lock(mutex);
+		FreeNode *&freeList = freeLists[size/align - 1];
+		freeList = new (ptr) FreeNode{freeList};
+	}
+public:
+	DrawableArena(const DrawableArena &other) = delete;
+
+	static DrawableArena * create() {
+		DrawableArena *arena = new DrawableArena();
+		arena->retain();
+		return arena;
+	}
+	void retain() {
+		++refs;
+	}
+	void release() {
+		if (--refs == 0) delete this;
+	}
+
+	/// Allocates from the arena if there is one (and the size is small enough), otherwise from the heap
+	static void * allocate(DrawableArena *arena, size_t size) {
+		size_t total = headerSize + (size + align - 1)/align*align;
+		if (total > maxPooled) arena = nullptr;
+		char *raw;
+		if (arena) {
+			raw = (char *)arena->take(total);
+			arena->retain();
+		} else {
+			raw = (char *)::operator new(total);
+		}
+		new (raw) Header{arena, total};
+		return raw + headerSize;
+	}
+	static void deallocate(void *ptr) {
+		if (!ptr) return;
+		char *raw = (char *)ptr - headerSize;
+		Header header = *(Header *)raw;
+		if (header.arena) {
+			header.arena->give(raw, header.size);
+			header.arena->release();
+		} else {
+			::operator delete(raw);
+		}
 	}
 };
 
@@ -463,46 +2382,143 @@ public:
 	Copy/assign is disabled, to prevent accidental copying when you should be holding a reference.
 */
 class SvgDrawable {
+	DrawableArena *arenaPtr = nullptr;
 	std::vector<std::unique_ptr<SvgDrawable>> children, layoutChildren;
 	bool hasLayout = false;
+	unsigned long layoutCount = 0;
 protected:
 	Bounds bounds;
 	
-	void invalidateLayout() {
+	virtual void invalidateLayout() {
 		hasLayout = bounds.set = false;
 		for (auto &c : children) c->invalidateLayout();
 		layoutChildren.resize(0);
 	}
 	virtual void layout(const PlotStyle &style) {
 		hasLayout = true;
+		++layoutCount;
 		auto processChild = [&](std::unique_ptr<SvgDrawable> &child) {
 			child->layoutIfNeeded(style);
 			if (bounds.set) {
 				if (child->bounds.set) bounds.expandTo(child->bounds);
 			} else {
-				bounds = child->bounds;
+				bounds = child->bounds;
+			}
+		};
+		for (auto &c : layoutChildren) processChild(c);
+		for (auto &c : children) processChild(c);
+	};
+	/** Adds everything (apart from the style) which affects the layout to a cache key, so an unchanged layout can be kept between writes.
+		This includes how many times it's been laid out, in case it was also written separately. */
+	virtual void layoutKey(CacheKey &key) {
+		key.add(layoutCount).add(children.size());
+		for (auto &c : children) c->layoutKey(key);
+	}
+	/// Called single-threaded before any (possibly multi-threaded) layout, for setup which can affect other elements
+	virtual void prepareLayout(const PlotStyle &style) {
+		for (auto &c : layoutChildren) c->prepareLayoutIfNeeded(style);
+		for (auto &c : children) c->prepareLayoutIfNeeded(style);
+	}
+	/// These children are removed when the layout is invalidated
+	void addLayoutChild(SvgDrawable *child) {
+		child->shareArena(arena());
+		layoutChildren.emplace_back(child);
+	}
+	/// Uses the parent's arena for any elements this one creates, unless it already has its own
+	void shareArena(DrawableArena &arena) {
+		if (!arenaPtr) {
+			arenaPtr = &arena;
+			arena.retain();
+		}
+	}
+	/** Output from a previous write, which is re-used if its key hasn't changed.
+		The output is written with a separate `SvgWriter`, so (like `.parallelData()`) it can't use `SvgWriter::elementId()`. */
+	struct CachedFragment {
+		CacheKey key;
+		BufferSink buffer;
+		bool valid = false;
+
+		/// If the output is re-written, `newKey` is swapped with the old key (so the caller can re-use its storage)
+		template<class WriteFn>
+		void write(SvgWriter &svg, CacheKey &newKey, WriteFn &&writeFn) {
+			if (!valid || !(newKey == key)) {
+				buffer.clear();
+				{
+					SvgWriter fragmentSvg(buffer, svg);
+					writeFn(fragmentSvg);
+				}
+				std::swap(key, newKey);
+				valid = true;
+			}
+			svg.rawBytes(buffer.data(), buffer.size());
+		}
+	};
+	/// Writes in reverse order, with `.parallelData()` children written up-front across `svg.threads` threads
+	static void writeChildData(std::vector<std::unique_ptr<SvgDrawable>> &list, SvgWriter &svg, const PlotStyle &style) {
+		std::vector<size_t> parallelIndices;
+		if (svg.threads > 1 && !parallelForActive()) {
+			for (size_t i = 0; i < list.size(); ++i) {
+				if (list[i]->parallelData()) parallelIndices.push_back(i);
+			}
+		}
+		if (parallelIndices.size() < 2) {
+			for (int i = list.size() - 1; i >= 0; --i) {
+				list[i]->writeData(svg, style);
+			}
+			return;
+		}
+		std::vector<BufferSink> buffers(list.size());
+		parallelFor(parallelIndices.size(), svg.threads, [&](size_t index) {
+			size_t i = parallelIndices[index];
+			SvgWriter childSvg(buffers[i], svg);
+			list[i]->writeData(childSvg, style);
+		});
+		for (int i = list.size() - 1; i >= 0; --i) {
+			if (list[i]->parallelData()) {
+				svg.rawBytes(buffers[i].data(), buffers[i].size());
+			} else {
+				list[i]->writeData(svg, style);
 			}
-		};
-		for (auto &c : layoutChildren) processChild(c);
-		for (auto &c : children) processChild(c);
-	};
-	/// These children are removed when the layout is invalidated
-	void addLayoutChild(SvgDrawable *child) {
-		layoutChildren.emplace_back(child);
+		}
 	}
 public:
 	SvgDrawable() {}
-	virtual ~SvgDrawable() {}
+	virtual ~SvgDrawable() {
+		if (arenaPtr) arenaPtr->release();
+	}
 	SvgDrawable(const SvgDrawable &other) = delete;
 	SvgDrawable & operator =(const SvgDrawable &other) = delete;
 
+	/// Elements created with `new (parent.arena()) ...` are allocated from the parent's arena
+	static void * operator new(size_t size) {
+		return DrawableArena::allocate(nullptr, size);
+	}
+	static void * operator new(size_t size, DrawableArena &arena) {
+		return DrawableArena::allocate(&arena, size);
+	}
+	static void operator delete(void *ptr) {
+		DrawableArena::deallocate(ptr);
+	}
+	static void operator delete(void *ptr, DrawableArena &) {
+		DrawableArena::deallocate(ptr);
+	}
+	/// Arena for elements created by this one (shared with its parent, if it has one)
+	DrawableArena & arena() {
+		if (!arenaPtr) arenaPtr = DrawableArena::create();
+		return *arenaPtr;
+	}
+
 	Bounds layoutIfNeeded(const PlotStyle &style) {
 		if (!hasLayout) this->layout(style);
 		return bounds;
 	}
+	void prepareLayoutIfNeeded(const PlotStyle &style) {
+		if (!hasLayout) this->prepareLayout(style);
+	}
 
 	/// Takes ownership of the child
 	void addChild(SvgDrawable *child, bool front=false) {
+		child->shareArena(arena());
 		if (front) {
 			children.emplace(children.begin(), child);
 		} else {
@@ -510,13 +2526,14 @@ public:
 		}
 	}
 
+	/** Whether `.writeData()` can be written separately (with another `SvgWriter`) and then copied into the document.
+		This means it can't use any document state, such as `SvgWriter::elementId()`. */
+	virtual bool parallelData() const {
+		return false;
+	}
 	virtual void writeData(SvgWriter &svg, const PlotStyle &style) {
-		for (int i = layoutChildren.size() - 1; i >= 0; --i) {
-			layoutChildren[i]->writeData(svg, style);
-		}
-		for (int i = children.size() - 1; i >= 0; --i) {
-			children[i]->writeData(svg, style);
-		}
+		writeChildData(layoutChildren, svg, style);
+		writeChildData(children, svg, style);
 	}
 	virtual void writeLabel(SvgWriter &svg, const PlotStyle &style) {
 		for (int i = layoutChildren.size() - 1; i >= 0; --i) {
@@ -545,6 +2562,8 @@ public:
 
 /// Top-level objects which can generate SVG files
 class SvgFileDrawable : public SvgDrawable {
+	CacheKey writeKey, cachedLayoutKey;
+	bool hasCachedLayout = false;
 public:
 	virtual PlotStyle defaultStyle() const {
 		PlotStyle result;
@@ -554,17 +2573,35 @@ public:
 		return result;
 	}
 	
-	void write(std::ostream &o, const PlotStyle &style) {
-		this->invalidateLayout();
-		this->layout(style);
+	void write(OutputSink &output, const PlotStyle &style) {
+		CacheKey &key = writeKey;
+		key.clear();
+		style.cacheKey(key);
+		const std::string &css = style.minifiedCss(key);
+		// Only re-calculate the layout if the elements or style have changed since the last write
+		this->layoutKey(key);
+		if (!hasCachedLayout || !(key == cachedLayoutKey)) {
+			this->invalidateLayout();
+			this->layout(style);
+			cachedLayoutKey.clear();
+			style.cacheKey(cachedLayoutKey);
+			this->layoutKey(cachedLayoutKey);
+			hasCachedLayout = true;
+		}
 
 		// Add padding
 		auto bounds = this->bounds.pad(style.padding);
 		
 		int scale10 = 1;
 		while (style.scale > scale10*4) scale10 *= 10;
-		SvgWriter svg(o, bounds, style.precision*scale10);
-		svg.raw("<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"no\"?>\n<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n");
+		SvgWriter svg(output, bounds, style.precision*scale10);
+		svg.compactPaths = style.compactPaths;
+		svg.threads = style.threadCount();
+		svg.simplify = style.simplify;
+		if (style.simplifyTolerance > 0) svg.simplifyTolerance = style.simplifyTolerance/style.scale;
+		svg.raw("<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"no\"?>\n");
+		if (style.cssHref.size()) svg.raw("<?xml-stylesheet type=\"text/css\"").attr("href", style.cssHref).raw("?>\n");
+		svg.raw("<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n");
 		svg.tag("svg").attr("version", "1.1").attr("class", "svg-plot")
 			.attr("xmlns", "http://www.w3.org/2000/svg")
 			.attr("width", bounds.width()*style.scale, "pt").attr("height", bounds.height()*style.scale, "pt")
@@ -581,9 +2618,11 @@ public:
 			std::max(std::abs(this->bounds.top), std::abs(this->bounds.bottom))
 		)*std::sqrt(2));
 		svg.raw("<defs>");
-		for (size_t i = 0; i < style.markers.size(); ++i) {
-			svg.tag("g").attr("id", style.markerId(i)).attr("class", "svg-plot-marker");
-			svg.raw(style.markerRaw(i)).raw("</g>");
+		if (style.defsHref.empty()) {
+			for (size_t i = 0; i < style.markers.size(); ++i) {
+				svg.tag("g").attr("id", style.markerId(i)).attr("class", "svg-plot-marker");
+				svg.raw(style.markerRaw(i)).raw("</g>");
+			}
 		}
 		for (size_t i = 0; i < style.hatches.size(); ++i) {
 			auto &hatch = style.hatches[i];
@@ -607,41 +2646,37 @@ public:
 		}
 		svg.raw("</defs>");
 
-		svg.raw("<style>");
-		std::stringstream cssStream;
-		style.css(cssStream);
-		std::string css = cssStream.str();
-		const char *cPtr = css.c_str();
-		// Strip whitespace that doesn't appear between letters/numbers
-		bool letter = false, letterThenWhitespace = false;
-		while (*cPtr) {
-			char c = *(cPtr++);
-			if (c == '\t' || c == '\n' || c == ' ') {
-				letterThenWhitespace = letter;
-			} else {
-				letter = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '.' || c == ')' || c == ']';
-				if (letterThenWhitespace && letter) o << ' ';
-				letterThenWhitespace = false;
-				o << c;
-			}
-		}
-		svg.raw("</style>");
+		if (style.cssHref.empty()) svg.raw("<style>", css, "</style>");
 		if (style.scriptSrc.size() > 0) {
 			svg.raw("<script>").write(style.scriptSrc).raw("</script>");
 		}
 		if (style.scriptHref.size()) svg.tag("script", true).attr("href", style.scriptHref);
 		svg.raw("</svg>");
+		svg.flush();
+		output.flush();
 	}
-	void write(const std::string &svgFile, const PlotStyle &style) {
-		std::ofstream s(svgFile);
-		write(s, style);
+	void write(std::ostream &o, const PlotStyle &style) {
+		StreamSink sink(o);
+		write(sink, style);
+	}
+	/// Writes to a file, compressed if the name ends with `.svgz`.  Returns whether the file was written successfully.
+	bool write(const std::string &svgFile, const PlotStyle &style) {
+		FileSink sink(svgFile);
+		size_t length = svgFile.size();
+		if (length >= 5 && svgFile.compare(length - 5, 5, ".svgz") == 0) {
+			GzipSink gzip(sink, style.compression);
+			write(gzip, style);
+		} else {
+			write(sink, style);
+		}
+		return sink.good();
 	}
 	// If we aren't given a style, use the default one
 	void write(std::ostream &o) {
 		this->write(o, this->defaultStyle());
 	}
-	void write(const std::string &svgFile) {
-		write(svgFile, this->defaultStyle());
+	bool write(const std::string &svgFile) {
+		return write(svgFile, this->defaultStyle());
 	}
 	
 	/// Draws when this object goes out of scope
@@ -676,9 +2711,15 @@ struct Tick {
 
 	template<typename T>
 	Tick(T v) : value(static_cast<double>(v)) {
-		std::stringstream ss;
-		ss << value;
-		name = ss.str();
+		char buffer[DecimalFormat::maxLength];
+		int length = DecimalFormat::writeSignificant(value, 6, buffer);
+		if (length) {
+			name.assign(buffer, length);
+		} else {
+			std::stringstream ss;
+			ss << value;
+			name = ss.str();
+		}
 	}
 };
 
@@ -695,15 +2736,93 @@ struct Tick {
 		axis.majors(0, 10).minors(2, 4, 6, 8);
 	\endcode
 */
+class Axis;
+/// Data which contributes to the auto-scale of an axis, which only asks for it when it's set up
+class AxisSource {
+public:
+	virtual ~AxisSource() {}
+	/// Expands `extent` to include any values for the given axis
+	virtual void axisExtent(const Axis &axis, Extent &extent) = 0;
+	/// Called when an axis (which this source was added to) is destroyed
+	virtual void axisRemoved(const Axis &axis) = 0;
+};
+
 class Axis {
+	/// Linear and log scales are stored as plain values, and only `custom` uses the `unitMap` function.  For `log`, `scaleLow`/`scaleHigh` are the mapped (log) values.
+	enum class ScaleKind {custom, linear, log};
+	ScaleKind scaleKind = ScaleKind::custom;
+	double scaleLow = 0, scaleHigh = 1, scaleInvRange = 1;
+	double (*scaleLogFn)(double) = nullptr;
 	std::function<double(double)> unitMap;
+	/// Changes whenever the scale might have, so cached output can be checked
+	unsigned long scaleVersion = 0;
 	double autoMin, autoMax;
 	bool hasAutoValue = false;
-	bool autoScale, autoLabel;
+	bool autoScale = false, autoLabel = false;
+	bool autoTracking = false;
+	size_t autoTickCount = 0;
 	std::string _label = "";
 
+	/// Not copied along with the axis, since sources keep track of the axes they're added to
+	struct SourceList : public std::vector<AxisSource *> {
+		SourceList() {}
+		SourceList(const SourceList &) : std::vector<AxisSource *>() {}
+		SourceList & operator=(const SourceList &) {
+			return *this;
+		}
+	};
+	SourceList sources;
+
 	std::vector<Axis *> linked;
 	Axis *linkedParent = nullptr;
+	Axis & linkRoot() {
+		Axis *root = this;
+		while (root->linkedParent) root = root->linkedParent;
+		return *root;
+	}
+	/// Records a value for this axis and any linked ones which are still auto-scaling
+	void recordAutoValue(double v) {
+		if (!autoScale) return;
+		if (!hasAutoValue) {
+			autoMin = autoMax = v;
+			hasAutoValue = true;
+		} else {
+			autoMin = std::min(autoMin, v);
+			autoMax = std::max(autoMax, v);
+		}
+		for (auto other : linked) other->recordAutoValue(v);
+	}
+	void groupExtent(Extent &extent) {
+		for (auto source : sources) source->axisExtent(*this, extent);
+		for (auto other : linked) other->groupExtent(extent);
+	}
+	/// Collects values from the sources of all linked axes, if they're still wanted
+	void pullSources() {
+		if (!autoScale || autoTracking) return;
+		Axis &root = linkRoot();
+		if (!root.autoScale || root.autoTracking) return;
+		Extent extent;
+		root.groupExtent(extent);
+		if (extent.valid()) {
+			recordAutoValue(extent.min);
+			recordAutoValue(extent.max);
+		}
+	}
+	Axis & setScale(ScaleKind kind, double low, double high, double (*logFn)(double), const std::function<double(double)> &valueToUnit) {
+		// Anything added from now on doesn't affect the scale, but what's there already is kept (e.g. for auto-labelling)
+		pullSources();
+		autoScale = false;
+		// Custom scales can't be compared
+		if (kind == ScaleKind::custom || kind != scaleKind || low != scaleLow || high != scaleHigh || logFn != scaleLogFn) ++scaleVersion;
+		scaleKind = kind;
+		scaleLow = low;
+		scaleHigh = high;
+		scaleInvRange = 1/(high - low);
+		scaleLogFn = logFn;
+		unitMap = valueToUnit;
+		for (auto other : linked) other->setScale(kind, low, high, logFn, valueToUnit);
+		return *this;
+	}
 	void removeLinkedParent() {
 		if (!linkedParent) return;
 		for (auto iter = linkedParent->linked.begin(); iter != linkedParent->linked.end(); ++iter) {
@@ -735,32 +2854,79 @@ public:
 		autoLabel = true;
 	}
 	explicit Axis(const Axis &other) = default;
+
+	/// Axes created by a plot (with `new (plot.arena()) Axis(...)`) come from its arena, like other elements
+	static void * operator new(size_t size) {
+		return DrawableArena::allocate(nullptr, size);
+	}
+	static void * operator new(size_t size, DrawableArena &arena) {
+		return DrawableArena::allocate(&arena, size);
+	}
+	static void operator delete(void *ptr) {
+		DrawableArena::deallocate(ptr);
+	}
+	static void operator delete(void *ptr, DrawableArena &) {
+		DrawableArena::deallocate(ptr);
+	}
 	~Axis() {
 		removeLinkedParent();
-		for (auto other : linked) other->removeLinkedParent();
+		for (auto other : linked) other->linkedParent = nullptr;
+		for (auto source : sources) source->axisRemoved(*this);
 	}
 
 	/// Register a value for the auto-scale
 	void autoValue(double v) {
 		if (linkedParent) return linkedParent->autoValue(v);
-		if (!autoScale) return;
-		if (!hasAutoValue) {
-			autoMin = autoMax = v;
-			hasAutoValue = true;
-		} else {
-			autoMin = std::min(autoMin, v);
-			autoMax = std::max(autoMax, v);
-		}
-		// TODO: why doesn't this cause an infinite loop?
-		for (auto other : linked) other->autoValue(v);
+		recordAutoValue(v);
+	}
+	/** Adds a source of auto-scale values, which is only asked for its extent when the axis is set up.
+		Sources of linked axes are shared, so a source with lots of data doesn't have to push every value to every linked axis. */
+	void addSource(AxisSource *source) {
+		sources.push_back(source);
+	}
+	void removeSource(AxisSource *source) {
+		sources.erase(std::remove(sources.begin(), sources.end(), source), sources.end());
+	}
+	/** Re-calculates the auto-scale and auto-labels from the current data every time the axis is set up, instead of fixing them the first time.
+		This is for plots which are written repeatedly while their data changes (e.g. using `Line2D::ringBuffer()`). */
+	Axis & autoTrack(bool track=true) {
+		autoTracking = track;
+		for (auto other : linked) other->autoTrack(track);
+		return *this;
 	}
 	void autoSetup() {
-		if (hasAutoValue) {
-			if (autoScale) linear(autoMin, autoMax);
-			if (autoLabel) minors(autoMin, autoMax);
+		if (autoTracking) {
+			trackSetup();
+		} else {
+			pullSources();
+			if (hasAutoValue) {
+				if (autoScale) linear(autoMin, autoMax);
+				if (autoLabel) minors(autoMin, autoMax);
+			}
 		}
 		for (auto other : linked) other->autoSetup();
 	}
+private:
+	void trackSetup() {
+		Extent extent;
+		if (hasAutoValue) extent.include(autoMin).include(autoMax);
+		linkRoot().groupExtent(extent);
+		if (!extent.valid()) return;
+		if (autoScale) {
+			linear(extent.min, extent.max);
+			autoScale = true;
+		}
+		if (autoLabel) {
+			// Replace the previous auto-labels (without propagating to linked axes, which do their own)
+			tickList.erase(tickList.end() - std::min(autoTickCount, tickList.size()), tickList.end());
+			Tick low(extent.min), high(extent.max);
+			low.strength = high.strength = Tick::Strength::minor;
+			tickList.push_back(low);
+			tickList.push_back(high);
+			autoTickCount = 2;
+		}
+	}
+public:
 	/// Prevent auto-labelling
 	Axis & blank(bool includeLinked=false) {
 		tickList.clear();
@@ -781,7 +2947,14 @@ public:
 	}
 	/// Copy ticks/label from another axis, optionally removing their text
 	Axis & copyFrom(Axis &other, bool clearLabels=false) {
+		other.pullSources();
+		scaleKind = other.scaleKind;
+		scaleLow = other.scaleLow;
+		scaleHigh = other.scaleHigh;
+		scaleInvRange = other.scaleInvRange;
+		scaleLogFn = other.scaleLogFn;
 		unitMap = other.unitMap;
+		++scaleVersion;
 		for (Tick tick : other.tickList) {
 			if (clearLabels) tick.name = "";
 			tickList.push_back(tick);
@@ -791,6 +2964,7 @@ public:
 		hasAutoValue = other.hasAutoValue;
 		autoScale = other.autoScale;
 		autoLabel = other.autoLabel;
+		autoTracking = other.autoTracking;
 		for (auto &t : tickList) {
 			autoValue(t.value);
 		}
@@ -828,10 +3002,7 @@ public:
 	}
 
 	Axis & range(std::function<double(double)> valueToUnit) {
-		autoScale = false;
-		unitMap = valueToUnit;
-		for (auto other : linked) other->range(valueToUnit);
-		return *this;
+		return setScale(ScaleKind::custom, 0, 1, nullptr, valueToUnit);
 	}
 	Axis & range(double map(double)) {
 		return range(std::function<double(double)>(map));
@@ -843,19 +3014,71 @@ public:
 			return (mapped - lowMapped)/(highMapped - lowMapped);
 		});
 	}
+	/// If `map` is `std::log` (or `log2`/`log10`), this is a log scale, which doesn't need a `std::function`
 	Axis & range(double map(double), double lowValue, double highValue) {
-		return range(std::function<double(double)>(map), lowValue, highValue);
+		bool isLog = (map == (double (*)(double))std::log) || (map == (double (*)(double))std::log2) || (map == (double (*)(double))std::log10);
+		if (!isLog) return range(std::function<double(double)>(map), lowValue, highValue);
+		return setScale(ScaleKind::log, map(lowValue), map(highValue), map, nullptr);
 	}
 	Axis & linear(double low, double high) {
-		return range([=](double v) {
-			return (v - low)/(high - low);
-		});
+		return setScale(ScaleKind::linear, low, high, nullptr, nullptr);
 	}
 	
-	double map(double v) {
-		double unit = unitMap(v);
+	double map(double v) const {
+		double unit;
+		if (scaleKind == ScaleKind::linear) {
+			unit = (v - scaleLow)*scaleInvRange;
+		} else if (scaleKind == ScaleKind::log) {
+			unit = (scaleLogFn(v) - scaleLow)*scaleInvRange;
+		} else {
+			unit = unitMap(v);
+		}
 		return drawLow + unit*(drawHigh - drawLow);
 	}
+	/// Adds the mapping (scale and draw range) to a cache key
+	void cacheKey(CacheKey &key) const {
+		key.add(scaleVersion).add(drawLow).add(drawHigh);
+	}
+	/// Adds the mapping, ticks, labels and any pending auto-scale to a cache key
+	void layoutKey(CacheKey &key) {
+		cacheKey(key);
+		key.add(flipped).add(_label).add(styleIndex.colour).add(styleIndex.dash).add(styleIndex.hatch).add(styleIndex.marker);
+		key.add(tickList.size());
+		for (auto &t : tickList) key.add(t.value).add(t.name).add(t.strength);
+		key.add(autoScale).add(autoLabel).add(autoTracking).add(hasAutoValue);
+		if (hasAutoValue) key.add(autoMin).add(autoMax);
+		if (autoScale || autoLabel || autoTracking) {
+			// The current data would change the auto-scale/labels
+			Extent extent;
+			linkRoot().groupExtent(extent);
+			key.add(extent.min).add(extent.max);
+		}
+	}
+	/** Maps `n` values at once, as tight loops for linear/log scales.
+		Only the linear mapping vectorises: `std::log()` can set `errno`, so compilers keep it as a call per value.  For log scales, the logs are taken in a separate pass, and the (vectorisable) linear part runs over the result. */
+	void mapArray(const double *in, double *out, size_t n) const {
+		double low = scaleLow, invRange = scaleInvRange, drawLow = this->drawLow, drawRange = drawHigh - drawLow;
+		if (scaleKind == ScaleKind::custom) {
+			for (size_t i = 0; i < n; ++i) {
+				out[i] = drawLow + unitMap(in[i])*drawRange;
+			}
+			return;
+		}
+		const double *values = in;
+		if (scaleKind == ScaleKind::log) {
+			if (scaleLogFn == (double (*)(double))std::log) {
+				for (size_t i = 0; i < n; ++i) out[i] = std::log(in[i]);
+			} else {
+				auto logFn = scaleLogFn;
+				for (size_t i = 0; i < n; ++i) out[i] = logFn(in[i]);
+			}
+			values = out;
+		}
+		// Same arithmetic as `.map()`, so the results are identical
+		for (size_t i = 0; i < n; ++i) {
+			out[i] = drawLow + ((values[i] - low)*invRange)*drawRange;
+		}
+	}
 
 	std::vector<Tick> tickList;
 
@@ -952,7 +3175,7 @@ protected:
 		double fontSize = isValue ? style.valueSize : style.labelSize;
 
 		// Assume all text/labels are UTF-8
-		textWidth = estimateUtf8Width(text.c_str())*fontSize*style.fontAspectRatio;
+		textWidth = style.metrics().width(text)*fontSize*style.fontAspectRatio;
 
 		if (vertical) {
 			this->bounds = {x - fontSize*0.5, x + fontSize*0.5, y - textWidth*(alignment - 1)*0.5, y - textWidth*(alignment + 1)*0.5};
@@ -973,7 +3196,7 @@ public:
 /** A line on a 2D plot, with fill and/or stroke
 	\image html filled-circles.svg
 */
-class Line2D : public SvgDrawable {
+class Line2D : public SvgDrawable, public AxisSource {
 	bool _drawLine = true;
 	bool _drawFill = false;
 	bool hasFillToX = false, hasFillToY = false;
@@ -981,29 +3204,291 @@ class Line2D : public SvgDrawable {
 	Line2D *fillToLine = nullptr;
 	
 	Axis &axisX, &axisY;
-	std::vector<Point2D> points;
+	/// Points stored as separate x/y columns, so they can be bulk-copied and processed in tight loops
+	struct PointColumns {
+		std::vector<double> x, y;
+		// Borrowed (caller-owned) data, with an implicit `xStart + i*xStep` if there's no `xData`
+		bool borrowed = false;
+		const double *xData = nullptr, *yData = nullptr;
+		size_t borrowedSize = 0, xStride = 1, yStride = 1;
+		double xStart = 0, xStep = 1;
+		// Ring-buffer mode (if `ringCapacity` is non-zero): once full, new points overwrite the oldest one, at `ringStart`
+		size_t ringCapacity = 0, ringStart = 0;
+
+		size_t size() const {
+			return borrowed ? borrowedSize : x.size();
+		}
+		size_t ringIndex(size_t i) const {
+			i += ringStart;
+			return (i >= x.size()) ? i - x.size() : i;
+		}
+		double xAt(size_t i) const {
+			if (!borrowed) return x[ringIndex(i)];
+			return xData ? xData[i*xStride] : xStart + i*xStep;
+		}
+		double yAt(size_t i) const {
+			return borrowed ? yData[i*yStride] : y[ringIndex(i)];
+		}
+		Point2D operator[](size_t i) const {
+			return {xAt(i), yAt(i)};
+		}
+		Point2D back() const {
+			return (*this)[size() - 1];
+		}
+		void push_back(Point2D p) {
+			own();
+			if (ringCapacity && x.size() >= ringCapacity) {
+				x[ringStart] = p.x;
+				y[ringStart] = p.y;
+				if (++ringStart == x.size()) ringStart = 0;
+			} else {
+				x.push_back(p.x);
+				y.push_back(p.y);
+			}
+		}
+		void append(const double *newX, const double *newY, size_t count) {
+			own();
+			if (ringCapacity) {
+				for (size_t i = 0; i < count; ++i) push_back({newX[i], newY[i]});
+				return;
+			}
+			x.insert(x.end(), newX, newX + count);
+			y.insert(y.end(), newY, newY + count);
+		}
+		void clear() {
+			borrowed = false;
+			x.clear();
+			y.clear();
+			ringStart = 0;
+		}
+		/// Sets the ring-buffer capacity (0 to disable), keeping the most recent points in order
+		void setRingCapacity(size_t capacity) {
+			own();
+			std::rotate(x.begin(), x.begin() + ringStart, x.end());
+			std::rotate(y.begin(), y.begin() + ringStart, y.end());
+			ringStart = 0;
+			ringCapacity = capacity;
+			trimToCapacity();
+		}
+		void trimToCapacity() {
+			if (!ringCapacity || x.size() <= ringCapacity) return;
+			size_t excess = x.size() - ringCapacity;
+			x.erase(x.begin(), x.begin() + excess);
+			y.erase(y.begin(), y.begin() + excess);
+		}
+		/// Size of a block starting at `start` (or ending at `end`), which doesn't cross the wrap-around point of a ring buffer
+		size_t blockAfter(size_t start, size_t maxCount) const {
+			size_t count = std::min(maxCount, size() - start);
+			size_t wrap = x.size() - ringStart;
+			if (ringStart && !borrowed && start < wrap) count = std::min(count, wrap - start);
+			return count;
+		}
+		size_t blockBefore(size_t end, size_t maxCount) const {
+			size_t count = std::min(maxCount, end);
+			size_t wrap = x.size() - ringStart;
+			if (ringStart && !borrowed && end > wrap) count = std::min(count, end - wrap);
+			return count;
+		}
+		/// Contiguous x/y values starting at `start`, either directly from the data or copied into `scratch`
+		const double * xBlock(size_t start, size_t count, double *scratch) const {
+			if (!borrowed) return columnBlock(x, start, count, scratch);
+			if (xData && xStride == 1) return xData + start;
+			for (size_t i = 0; i < count; ++i) scratch[i] = xAt(start + i);
+			return scratch;
+		}
+		const double * yBlock(size_t start, size_t count, double *scratch) const {
+			if (!borrowed) return columnBlock(y, start, count, scratch);
+			if (yStride == 1) return yData + start;
+			for (size_t i = 0; i < count; ++i) scratch[i] = yAt(start + i);
+			return scratch;
+		}
+		void extent(Extent &extentX, Extent &extentY) const {
+			size_t count = size();
+			if (!borrowed) {
+				extentX.include(x.data(), count);
+				extentY.include(y.data(), count);
+				return;
+			}
+			if (xData) {
+				extentX.include(xData, count, xStride);
+			} else if (count) {
+				extentX.include(xStart).include(xStart + (count - 1)*xStep);
+			}
+			extentY.include(yData, count, yStride);
+		}
+		/// Copies any borrowed data, so that more points can be added
+		void own() {
+			if (!borrowed) return;
+			size_t count = size();
+			x.resize(count);
+			y.resize(count);
+			for (size_t i = 0; i < count; ++i) {
+				x[i] = xAt(i);
+				y[i] = yAt(i);
+			}
+			borrowed = false;
+			trimToCapacity();
+		}
+	private:
+		const double * columnBlock(const std::vector<double> &column, size_t start, size_t count, double *scratch) const {
+			size_t index = ringIndex(start);
+			if (index + count <= column.size()) return column.data() + index;
+			for (size_t i = 0; i < count; ++i) scratch[i] = column[ringIndex(start + i)];
+			return scratch;
+		}
+	};
+	PointColumns points;
 	struct Marker {
 		Point2D point;
 		int shape;
 	};
 	std::vector<Marker> markers;
+	/** Frames keep their points in shared chunks, so data which is unchanged from the previous frame isn't copied again.
+		A chunk can also be shared when a later frame only appends to it, since each frame only uses the first `.size` points. */
+	struct FrameChunk {
+		std::vector<double> x, y;
+	};
 	struct Frame {
 		double time;
-		std::vector<Point2D> points;
-		std::vector<Marker> markers;
+		std::vector<std::shared_ptr<FrameChunk>> chunks;
+		size_t size;
+		std::shared_ptr<const std::vector<Marker>> markers;
 	};
 	double framesLoopTime = 0;
 	std::vector<Frame> frames;
 	Point2D latest{0, 0};
+	/// Auto-scale extents, where the points' one is only recalculated (if needed) when an axis asks for it
+	Extent pointsExtentX, pointsExtentY, markersExtentX, markersExtentY, framesExtentX, framesExtentY;
+	bool pointsExtentValid = true;
+	bool hasAxisX = true, hasAxisY = true;
+	/// Min/max of a sliding window, using monotonic queues so each value is added/removed at most once
+	struct WindowExtent {
+		struct Entry {
+			size_t index;
+			double value;
+		};
+		std::deque<Entry> minQueue, maxQueue;
+
+		void add(size_t index, double v) {
+			if (std::isnan(v)) return;
+			while (!minQueue.empty() && minQueue.back().value >= v) minQueue.pop_back();
+			minQueue.push_back({index, v});
+			while (!maxQueue.empty() && maxQueue.back().value <= v) maxQueue.pop_back();
+			maxQueue.push_back({index, v});
+		}
+		/// Removes everything before `index`
+		void expire(size_t index) {
+			while (!minQueue.empty() && minQueue.front().index < index) minQueue.pop_front();
+			while (!maxQueue.empty() && maxQueue.front().index < index) maxQueue.pop_front();
+		}
+		Extent extent() const {
+			Extent result;
+			if (!minQueue.empty()) result.include(minQueue.front().value).include(maxQueue.front().value);
+			return result;
+		}
+		void clear() {
+			minQueue.clear();
+			maxQueue.clear();
+		}
+	};
+	// In ring-buffer mode, these track the window instead of rescanning the points
+	WindowExtent windowX, windowY;
+	size_t windowEnd = 0;
+	void addToWindow(double x, double y) {
+		if (!pointsExtentValid) return;
+		windowX.add(windowEnd, x);
+		windowY.add(windowEnd, y);
+		++windowEnd;
+		if (windowEnd > points.size()) {
+			windowX.expire(windowEnd - points.size());
+			windowY.expire(windowEnd - points.size());
+		}
+	}
+	void updatePointsExtent() {
+		if (points.ringCapacity) {
+			if (!pointsExtentValid) {
+				windowX.clear();
+				windowY.clear();
+				windowEnd = 0;
+				pointsExtentValid = true;
+				for (size_t i = 0; i < points.size(); ++i) addToWindow(points.xAt(i), points.yAt(i));
+			}
+			pointsExtentX = windowX.extent();
+			pointsExtentY = windowY.extent();
+			return;
+		}
+		if (pointsExtentValid) return;
+		pointsExtentX = pointsExtentY = Extent();
+		points.extent(pointsExtentX, pointsExtentY);
+		pointsExtentValid = true;
+	}
+	bool hasSimplify = false;
+	PlotStyle::Simplify simplifyMode;
+	double simplifyTolerance = 0;
+	/// Incremented whenever something which affects `.writeData()` changes, for `PlotStyle::cacheData`
+	unsigned long dataVersion = 0;
+	CachedFragment dataCache;
+	CacheKey dataKey; // re-used between writes
+	PointColumns framePointsScratch; // scratch space for `.writePaths()`
+	PointColumns mappedMarkers; // scratch space for `.writeLabel()`
+	std::vector<PointColumns> mappedFrameMarkers;
 	
+	/// Reduces each run of points within a single pixel-column to its first/min/max/last points
+	struct ColumnDecimator {
+		SvgWriter &svg;
+		double columnScale;
+		bool active;
+		struct Entry {
+			Point2D point;
+			size_t index;
+		};
+		Entry first, min, max, last;
+		double column = 0;
+		size_t count = 0, index = 0;
+
+		ColumnDecimator(SvgWriter &svg, double columnScale, bool active) : svg(svg), columnScale(columnScale), active(active) {}
+
+		void add(double x, double y, bool alwaysInclude=false) {
+			if (!active || alwaysInclude) {
+				flush();
+				return svg.addPoint(x, y, alwaysInclude);
+			}
+			if (std::isnan(x) || std::isnan(y)) return;
+			double c = std::floor(x*columnScale);
+			Entry e{{x, y}, index++};
+			if (count && c == column) {
+				if (y < min.point.y) min = e;
+				if (y > max.point.y) max = e;
+				last = e;
+				++count;
+			} else {
+				flush();
+				column = c;
+				first = min = max = last = e;
+				count = 1;
+			}
+		}
+		void flush() {
+			if (!count) return;
+			svg.addPoint(first.point.x, first.point.y);
+			Entry a = min, b = max;
+			if (a.index > b.index) std::swap(a, b);
+			if (a.index != first.index && a.index != last.index) svg.addPoint(a.point.x, a.point.y);
+			if (b.index != first.index && b.index != last.index && b.index != a.index) svg.addPoint(b.point.x, b.point.y);
+			if (last.index != first.index) svg.addPoint(last.point.x, last.point.y);
+			count = 0;
+		}
+	};
+
 	template<class WriteValue>
 	void writeAnimationAttrs(SvgWriter &svg, WriteValue &&writeValue) {
 		double lastFrame = frames.back().time;
 		double framesEnd = std::max(framesLoopTime, lastFrame);
+		// Times get more precision than coordinates
 		if (framesLoopTime > 0) {
-			svg.attr("dur", framesLoopTime, "s").attr("repeatCount", "indefinite");
+			svg.raw(" dur=\"").number(framesLoopTime, 1e6).raw("s\"").attr("repeatCount", "indefinite");
 		} else {
-			svg.attr("dur", framesEnd);
+			svg.raw(" dur=\"").number(framesEnd, 1e6).raw("\"");
 		}
 		svg.raw(" values=\"");
 		for (size_t i = 0; i < frames.size(); ++i) {
@@ -1017,70 +3502,246 @@ class Line2D : public SvgDrawable {
 		svg.raw("\" keyTimes=\"");
 		for (size_t i = 0; i < frames.size(); ++i) {
 			if (i > 0) svg.raw(";");
-			svg.write(frames[i].time/framesEnd);
+			svg.number(frames[i].time/framesEnd, 1e6);
 		}
 		if (framesLoopTime > lastFrame || smoothFrame) svg.raw(";1");
 	}
 public:
 	PlotStyle::Counter styleIndex;
 
-	Line2D(Axis &axisX, Axis &axisY, PlotStyle::Counter styleIndex) : axisX(axisX), axisY(axisY), styleIndex(styleIndex) {}
+	Line2D(Axis &axisX, Axis &axisY, PlotStyle::Counter styleIndex) : axisX(axisX), axisY(axisY), styleIndex(styleIndex) {
+		axisX.addSource(this);
+		axisY.addSource(this);
+	}
+	~Line2D() {
+		if (hasAxisX) axisX.removeSource(this);
+		if (hasAxisY) axisY.removeSource(this);
+	}
+
+	void axisExtent(const Axis &axis, Extent &extent) override {
+		if (&axis != &axisX && &axis != &axisY) return;
+		updatePointsExtent();
+		if (&axis == &axisX) extent.include(pointsExtentX).include(markersExtentX).include(framesExtentX);
+		if (&axis == &axisY) extent.include(pointsExtentY).include(markersExtentY).include(framesExtentY);
+	}
+	void axisRemoved(const Axis &axis) override {
+		if (&axis == &axisX) hasAxisX = false;
+		if (&axis == &axisY) hasAxisY = false;
+	}
+
+	bool parallelData() const override {
+		return true;
+	}
+	/// Labels depend on the axes and style index
+	void layoutKey(CacheKey &key) override {
+		axisX.cacheKey(key);
+		axisY.cacheKey(key);
+		key.add(styleIndex.colour).add(styleIndex.dash).add(styleIndex.hatch).add(styleIndex.marker);
+		SvgDrawable::layoutKey(key);
+	}
 	
 	Line2D & add(double x, double y) {
 		latest = {x, y};
+		++dataVersion;
 		points.push_back({x, y});
-		axisX.autoValue(x);
-		axisY.autoValue(y);
+		if (points.ringCapacity) {
+			addToWindow(x, y);
+		} else {
+			pointsExtentValid = false;
+		}
 		return *this;
 	}
 
+private:
+	static const double * columnData(const double *column) {
+		return column;
+	}
+	static const double * columnData(const std::vector<double> &column) {
+		return column.data();
+	}
+	// Anything which converts to `const double *` (e.g. non-`const` pointers or arrays) uses the bulk overload above
+	template<class Column>
+	static typename std::enable_if<!std::is_convertible<const Column &, const double *>::value, const Column &>::type columnData(const Column &column) {
+		return column;
+	}
 	template<class X, class Y>
-	Line2D & addArray(X &&x, Y &&y, size_t size) {
+	void appendColumns(const X &x, const Y &y, size_t size) {
 		for (size_t i = 0; i < size; ++i) add(x[i], y[i]);
+	}
+	void pointsReplaced() {
+		++dataVersion;
+		pointsExtentValid = false;
+		if (points.size()) latest = points.back();
+	}
+	void appendColumns(const double *x, const double *y, size_t size) {
+		if (!size) return;
+		if (points.ringCapacity) {
+			// Only the ones which fit are kept
+			size_t skip = (size > points.ringCapacity) ? size - points.ringCapacity : 0;
+			for (size_t i = skip; i < size; ++i) add(x[i], y[i]);
+			return;
+		}
+		points.append(x, y, size);
+		++dataVersion;
+		pointsExtentValid = false;
+		latest = points.back();
+	}
+public:
+	/// Adds points from two indexable columns.  Contiguous `double` data (pointers or `std::vector<double>`) is copied in bulk.
+	template<class X, class Y>
+	Line2D & addArray(X &&x, Y &&y, size_t size) {
+		appendColumns(columnData(x), columnData(y), size);
 		return *this;
 	}
 	template<class X, class Y>
 	Line2D & addArray(X &&x, Y &&y) {
 		return addArray(std::forward<X>(x), std::forward<Y>(y), std::min<size_t>(x.size(), y.size()));
 	}
+
+	/** Uses caller-owned data for the points (replacing any existing ones) instead of copying it.
+		The data must stay valid and unchanged until the last `.write()`, since it's read again when writing.  Adding more points makes a copy.
+		Strides are in elements, not bytes. */
+	Line2D & bind(const double *x, const double *y, size_t size, size_t xStride=1, size_t yStride=1) {
+		size_t ringCapacity = points.ringCapacity;
+		points = PointColumns();
+		points.ringCapacity = ringCapacity;
+		points.borrowed = true;
+		points.xData = x;
+		points.yData = y;
+		points.borrowedSize = size;
+		points.xStride = xStride;
+		points.yStride = yStride;
+		pointsReplaced();
+		return *this;
+	}
+	/// Uses caller-owned data for `y` (see above), with evenly-spaced `x` values
+	Line2D & bind(double xStart, double xStep, const double *y, size_t size, size_t yStride=1) {
+		size_t ringCapacity = points.ringCapacity;
+		points = PointColumns();
+		points.ringCapacity = ringCapacity;
+		points.borrowed = true;
+		points.xData = nullptr;
+		points.xStart = xStart;
+		points.xStep = xStep;
+		points.yData = y;
+		points.borrowedSize = size;
+		points.yStride = yStride;
+		pointsReplaced();
+		return *this;
+	}
 	
+	/** Keeps only the most recent `capacity` points (0 to disable), with new points overwriting the oldest ones, e.g. for live plots which are written repeatedly.
+		Memory is bounded, and the auto-scale follows the current points without rescanning them.  Bound data isn't limited until more points are added. */
+	Line2D & ringBuffer(size_t capacity) {
+		points.setRingCapacity(capacity);
+		++dataVersion;
+		pointsExtentValid = false;
+		return *this;
+	}
+
 	Line2D & marker(double x, double y, int shape=-1) {
 		latest = {x, y};
 		markers.push_back({{x, y}, shape});
-		axisX.autoValue(x);
-		axisY.autoValue(y);
+		markersExtentX.include(x);
+		markersExtentY.include(y);
 		return *this;
 	}
 
 	void toFrame(double time, bool clear=true) override {
 		SvgDrawable::toFrame(time, clear);
-		frames.push_back({time, points, markers});
+		++dataVersion;
+		addFrame(time);
+		updatePointsExtent();
+		framesExtentX.include(pointsExtentX).include(markersExtentX);
+		framesExtentY.include(pointsExtentY).include(markersExtentY);
 		if (clear) {
 			points.clear();
 			markers.clear();
+			pointsExtentValid = false;
+			markersExtentX = markersExtentY = Extent();
 		}
 		framesLoopTime = std::max(time, framesLoopTime);
 	}
 	void loopFrame(double endTime) override {
 		SvgDrawable::loopFrame(endTime);
+		++dataVersion;
 		framesLoopTime = endTime;
 	}
 	void clearFrames() override {
 		SvgDrawable::clearFrames();
+		++dataVersion;
 		frames.resize(0);
 		framesLoopTime = 0;
+		framesExtentX = framesExtentY = Extent();
 	}
 	bool smoothFrame = false;
+private:
+	void addFrame(double time) {
+		const Frame *prev = frames.size() ? &frames.back() : nullptr;
+		Frame frame{time, {}, points.size(), nullptr};
+		constexpr size_t chunkSize = 1024;
+		double chunkX[chunkSize], chunkY[chunkSize];
+		for (size_t start = 0; start < frame.size; start += chunkSize) {
+			size_t count = std::min(chunkSize, frame.size - start);
+			for (size_t i = 0, blockCount; i < count; i += blockCount) {
+				blockCount = points.blockAfter(start + i, count - i);
+				std::memcpy(chunkX + i, points.xBlock(start + i, blockCount, chunkX + i), blockCount*sizeof(double));
+				std::memcpy(chunkY + i, points.yBlock(start + i, blockCount, chunkY + i), blockCount*sizeof(double));
+			}
+			std::shared_ptr<FrameChunk> chunk;
+			size_t chunkIndex = start/chunkSize;
+			if (prev && chunkIndex < prev->chunks.size()) {
+				auto &prevChunk = prev->chunks[chunkIndex];
+				size_t prevCount = std::min(chunkSize, prev->size - start);
+				bool samePrefix = prevCount <= count
+					&& std::memcmp(prevChunk->x.data(), chunkX, prevCount*sizeof(double)) == 0
+					&& std::memcmp(prevChunk->y.data(), chunkY, prevCount*sizeof(double)) == 0;
+				// Unchanged, or only appended to (as long as no other frame has extended it)
+				if (samePrefix && (prevCount == count || prevChunk->x.size() == prevCount)) {
+					prevChunk->x.insert(prevChunk->x.end(), chunkX + prevCount, chunkX + count);
+					prevChunk->y.insert(prevChunk->y.end(), chunkY + prevCount, chunkY + count);
+					chunk = prevChunk;
+				}
+			}
+			if (!chunk) {
+				chunk = std::make_shared<FrameChunk>();
+				chunk->x.assign(chunkX, chunkX + count);
+				chunk->y.assign(chunkY, chunkY + count);
+			}
+			frame.chunks.push_back(std::move(chunk));
+		}
+		auto sameMarker = [](const Marker &a, const Marker &b) {
+			return a.point.x == b.point.x && a.point.y == b.point.y && a.shape == b.shape;
+		};
+		if (prev && prev->markers->size() == markers.size() && std::equal(markers.begin(), markers.end(), prev->markers->begin(), sameMarker)) {
+			frame.markers = prev->markers;
+		} else {
+			frame.markers = std::make_shared<const std::vector<Marker>>(markers);
+		}
+		frames.push_back(std::move(frame));
+	}
+	/// Copies a frame's points into re-used scratch space, for writing
+	const PointColumns & framePoints(const Frame &frame) {
+		framePointsScratch.clear();
+		for (auto &chunk : frame.chunks) {
+			size_t count = std::min(chunk->x.size(), frame.size - framePointsScratch.size());
+			framePointsScratch.append(chunk->x.data(), chunk->y.data(), count);
+		}
+		return framePointsScratch;
+	}
+public:
 
 	/// @{
 	///@name Draw config
 
 	Line2D & drawLine(bool draw=true) {
 		_drawLine = draw;
+		++dataVersion;
 		return *this;
 	}
 	Line2D & drawFill(bool draw=true) {
 		_drawFill = draw;
+		++dataVersion;
 		return *this;
 	}
 	/// Start/end the fill at a given Y value
@@ -1089,6 +3750,7 @@ public:
 		hasFillToX = false;
 		hasFillToY = true;
 		fillToPoint = {0, y};
+		++dataVersion;
 		return *this;
 	}
 	/// Start/end the fill at a given X value
@@ -1097,12 +3759,22 @@ public:
 		hasFillToX = true;
 		hasFillToY = false;
 		fillToPoint = {x, 0};
+		++dataVersion;
 		return *this;
 	}
 	Line2D & fillTo(Line2D &other) {
 		_drawFill = true;
 		hasFillToX = hasFillToY = false;
 		fillToLine = &other;
+		++dataVersion;
+		return *this;
+	}
+	/// Overrides `PlotStyle::simplify` for this line.  If `tolerance` (pixels) is 0, it uses the style's tolerance.
+	Line2D & simplify(PlotStyle::Simplify mode, double tolerance=0) {
+		hasSimplify = true;
+		simplifyMode = mode;
+		simplifyTolerance = tolerance;
+		++dataVersion;
 		return *this;
 	}
 	/// @}
@@ -1181,7 +3853,7 @@ public:
 	Line2D & label(double valueX, double valueY, std::string name, double degrees, double distance=0) {
 		axisX.autoValue(valueX);
 		axisY.autoValue(valueY);
-		this->addChild(new LineLabel(axisX, axisY, {valueX, valueY}, name, degrees, distance, styleIndex));
+		this->addChild(new (this->arena()) LineLabel(axisX, axisY, {valueX, valueY}, name, degrees, distance, styleIndex));
 		return *this;
 	}
 
@@ -1193,9 +3865,9 @@ public:
 		size_t closest = 0;
 		double closestError = -1;
 		for (size_t i = 0; i < points.size(); ++i) {
-			if (closestError < 0 || closestError > std::abs(points[i].x - xIsh)) {
+			if (closestError < 0 || closestError > std::abs(points.xAt(i) - xIsh)) {
 				closest = i;
-				closestError = std::abs(points[i].x - xIsh);
+				closestError = std::abs(points.xAt(i) - xIsh);
 			}
 		}
 		Point2D latest = points[closest];
@@ -1208,17 +3880,30 @@ public:
 		size_t maxMarkers = markers.size();
 		bool animated = (frames.size() > 0);
 		for (auto &frame : frames) {
-			maxMarkers = std::max(maxMarkers, frame.markers.size());
+			maxMarkers = std::max(maxMarkers, frame.markers->size());
 		}
 		static constexpr double outOfRange = -10000;
+		// Map all marker positions up-front, using the axes' batch mapping
+		auto mapMarkers = [&](const std::vector<Marker> &list, PointColumns &mapped) {
+			for (auto &marker : list) mapped.push_back(marker.point);
+			axisX.mapArray(mapped.x.data(), mapped.x.data(), mapped.size());
+			axisY.mapArray(mapped.y.data(), mapped.y.data(), mapped.size());
+		};
+		mappedMarkers.clear();
+		mapMarkers(markers, mappedMarkers);
+		if (mappedFrameMarkers.size() < frames.size()) mappedFrameMarkers.resize(frames.size());
+		for (size_t i = 0; i < frames.size(); ++i) {
+			mappedFrameMarkers[i].clear();
+			mapMarkers(*frames[i].markers, mappedFrameMarkers[i]);
+		}
 		for (size_t m = 0; m < maxMarkers; ++m) {
 			double x = outOfRange, y = outOfRange;
 			auto shape = styleIndex;
 
 			if (m < markers.size()) {
 				auto &marker = markers[m];
-				x = axisX.map(marker.point.x);
-				y = axisY.map(marker.point.y);
+				x = mappedMarkers.x[m];
+				y = mappedMarkers.y[m];
 				if (x < xMin || x > xMax || y < yMin || y > yMax) {
 					x = y = outOfRange;
 				}
@@ -1227,7 +3912,7 @@ public:
 			if (animated || x != outOfRange || y != outOfRange) {
 				if (!animated) {
 					svg.tag("use", true)
-						.attr("href", "#", style.markerId(shape))
+						.attr("href", style.markerHref(shape))
 						.attr("class", style.fillClass(styleIndex), " ", style.strokeClass(styleIndex))
 						.attr("transform", "translate(", x, " ", y, ")");
 				} else {
@@ -1242,9 +3927,9 @@ public:
 						.attr("type", "translate");
 					writeAnimationAttrs(svg, [&](int index) {
 						double x = outOfRange, y = outOfRange;
-						if (m < frames[index].markers.size()) {
-							x = axisX.map(frames[index].markers[m].point.x);
-							y = axisY.map(frames[index].markers[m].point.y);
+						if (m < frames[index].markers->size()) {
+							x = mappedFrameMarkers[index].x[m];
+							y = mappedFrameMarkers[index].y[m];
 							if (x < xMin || x > xMax || y < yMin || y > yMax) {
 								x = y = outOfRange;
 							}
@@ -1259,38 +3944,96 @@ public:
 	}
 	
 	void writeData(SvgWriter &svg, const PlotStyle &style) override {
-		auto writePoints = [&](std::vector<Point2D> &points, bool fill) {
+		if (style.cacheData && !hasBorrowedData()) {
+			CacheKey &key = dataKey;
+			key.clear();
+			key.add(dataVersion).add(smoothFrame).add(style.scale).add(style.decimate);
+			key.add(style.fillClass(styleIndex)).add(style.hatchClass(styleIndex)).add(style.strokeClass(styleIndex)).add(style.dashClass(styleIndex));
+			axisX.cacheKey(key);
+			axisY.cacheKey(key);
+			if (fillToLine) {
+				key.add(fillToLine->dataVersion);
+				fillToLine->axisX.cacheKey(key);
+				fillToLine->axisY.cacheKey(key);
+			}
+			svg.cacheKey(key);
+			dataCache.write(svg, key, [&](SvgWriter &fragmentSvg) {
+				writePaths(fragmentSvg, style);
+			});
+		} else {
+			dataCache = CachedFragment();
+			writePaths(svg, style);
+		}
+		SvgDrawable::writeData(svg, style);
+	}
+private:
+	/// Bound data can change without the line knowing, so it's never cached (frames always have their own copy)
+	bool hasBorrowedData() const {
+		return points.borrowed || (fillToLine && fillToLine->points.borrowed);
+	}
+	void writePaths(SvgWriter &svg, const PlotStyle &style) {
+		// Decimation only helps if there are several points per column, and animation interpolation needs all the points
+		double columnScale = style.scale;
+		auto shouldDecimate = [&](size_t pointCount, const Axis &axis) {
+			return style.decimate && !smoothFrame && pointCount > 4*axis.drawSize()*columnScale;
+		};
+		auto prevSimplify = svg.simplify;
+		double prevSimplifyTolerance = svg.simplifyTolerance;
+		if (hasSimplify) {
+			svg.simplify = simplifyMode;
+			if (simplifyTolerance > 0) svg.simplifyTolerance = simplifyTolerance/style.scale;
+		}
+		// Points are mapped in blocks, using the axes' batch mapping
+		constexpr size_t blockSize = 256;
+		double scratch[blockSize], blockX[blockSize], blockY[blockSize];
+		auto mapBlock = [&](const PointColumns &points, const Axis &mapX, const Axis &mapY, size_t start, size_t count) {
+			mapX.mapArray(points.xBlock(start, count, scratch), blockX, count);
+			mapY.mapArray(points.yBlock(start, count, scratch), blockY, count);
+		};
+		auto writePoints = [&](const PointColumns &points, bool fill) {
 			if (!points.size()) return;
-			svg.startPath();
-			for (auto &p : points) {
-				svg.addPoint(axisX.map(p.x), axisY.map(p.y), smoothFrame);
+			svg.startPath(fill);
+			ColumnDecimator decimator(svg, columnScale, shouldDecimate(points.size(), axisX));
+			for (size_t start = 0, count; start < points.size(); start += count) {
+				count = points.blockAfter(start, blockSize);
+				mapBlock(points, axisX, axisY, start, count);
+				for (size_t i = 0; i < count; ++i) {
+					decimator.add(blockX[i], blockY[i], smoothFrame);
+				}
 			}
+			decimator.flush();
 			if (fill) {
 				if (fillToLine) {
 					auto &otherPoints = fillToLine->points;
-					for (int i = otherPoints.size() - 1; i >= 0; --i) {
-						auto &p = otherPoints[i];
-						svg.addPoint(fillToLine->axisX.map(p.x), fillToLine->axisY.map(p.y), (smoothFrame || i == 0));
+					ColumnDecimator otherDecimator(svg, columnScale, shouldDecimate(otherPoints.size(), fillToLine->axisX));
+					for (size_t end = otherPoints.size(); end > 0;) {
+						size_t count = otherPoints.blockBefore(end, blockSize);
+						end -= count;
+						mapBlock(otherPoints, fillToLine->axisX, fillToLine->axisY, end, count);
+						for (size_t i = count; i-- > 0;) {
+							otherDecimator.add(blockX[i], blockY[i], smoothFrame);
+						}
 					}
+					otherDecimator.flush();
 				} else if (hasFillToX) {
-					svg.addPoint(axisX.map(fillToPoint.x), axisY.map(points.back().y), true);
-					svg.addPoint(axisX.map(fillToPoint.x), axisY.map(points[0].y), true);
+					svg.addPoint(axisX.map(fillToPoint.x), axisY.map(points.back().y), smoothFrame);
+					svg.addPoint(axisX.map(fillToPoint.x), axisY.map(points[0].y), smoothFrame);
 				} else if (hasFillToY) {
-					svg.addPoint(axisX.map(points.back().x), axisY.map(fillToPoint.y), true);
-					svg.addPoint(axisX.map(points[0].x), axisY.map(fillToPoint.y), true);
+					svg.addPoint(axisX.map(points.back().x), axisY.map(fillToPoint.y), smoothFrame);
+					svg.addPoint(axisX.map(points[0].x), axisY.map(fillToPoint.y), smoothFrame);
 				}
 			}
 			svg.endPath();
 		};
 		auto writeD = [&](bool fill){
-			auto &p = (points.size() || !frames.size()) ? points : frames.back().points;
+			auto &p = (points.size() || !frames.size()) ? points : framePoints(frames.back());
 			svg.raw(" d=\"");
 			writePoints(p, fill);
 			if (frames.size() > 0) {
 				svg.raw("\">\n<animate")
 					.attr("attributeName", "d").attr("calcMode", smoothFrame ? "linear" : "discrete");
 				writeAnimationAttrs(svg, [&](size_t i) {
-					writePoints(frames[i].points, fill);
+					writePoints(framePoints(frames[i]), fill);
 				});
 				svg.raw("\"/></path>");
 			} else {
@@ -1308,7 +4051,8 @@ public:
 				.attr("class", "svg-plot-line ", style.strokeClass(styleIndex), " ", style.dashClass(styleIndex));
 			writeD(false);
 		}
-		SvgDrawable::writeData(svg, style);
+		svg.simplify = prevSimplify;
+		svg.simplifyTolerance = prevSimplifyTolerance;
 	}
 };
 
@@ -1325,13 +4069,22 @@ class Legend : public SvgFileDrawable {
 	std::vector<Entry> entries;
 public:
 	Legend(SvgFileDrawable &ref, Bounds dataBounds, double rx, double ry) : ref(ref), dataBounds(dataBounds), rx(rx), ry(ry) {}
+
+	void layoutKey(CacheKey &key) override {
+		key.add(entries.size());
+		for (auto &e : entries) {
+			key.add(e.name).add(e.stroke).add(e.fill).add(e.marker);
+			key.add(e.style.colour).add(e.style.dash).add(e.style.hatch).add(e.style.marker);
+		}
+		SvgFileDrawable::layoutKey(key);
+	}
 	
 	void layout(const PlotStyle &style) override {
 		Bounds refBounds = ref.layoutIfNeeded(style).pad(style.textPadding);
 		double exampleLineWidth = style.labelSize*1.5; // 1.5em
 		double longestLabel = 0;
 		for (auto &e : entries) {
-			longestLabel = std::max(longestLabel, estimateUtf8Width(e.name.c_str()));
+			longestLabel = std::max(longestLabel, style.metrics().width(e.name));
 		}
 		double width = exampleLineWidth + style.textPadding*3 + longestLabel*style.labelSize;
 		double height = style.textPadding*2 + entries.size()*style.labelSize*style.lineHeight;
@@ -1353,7 +4106,7 @@ public:
 			auto &entry = entries[i];
 			double labelX = topLeft.x + style.textPadding*2 + exampleLineWidth;
 			double labelY = location.top + style.textPadding + (i + 0.5)*style.labelSize*style.lineHeight;
-			auto *label = new TextLabel({labelX, labelY}, 1, entry.name, "svg-plot-label svg-plot-l" + std::to_string(i), false, false);
+			auto *label = new (this->arena()) TextLabel({labelX, labelY}, 1, entry.name, "svg-plot-label svg-plot-l" + std::to_string(i), false, false);
 			this->addLayoutChild(label);
 		}
 		SvgFileDrawable::layout(style);
@@ -1402,7 +4155,7 @@ public:
 			}
 			if (entry.marker) {
 				svg.tag("use", true)
-					.attr("href", "#", style.markerId(entry.style))
+					.attr("href", style.markerHref(entry.style))
 					.attr("class", style.fillClass(entry.style), " ", style.strokeClass(entry.style), " svg-plot-l", std::to_string(i))
 					.attr("transform", "translate(", (lineX1 + lineX2)/2, " ", lineY, ")");
 			}
@@ -1440,17 +4193,18 @@ class Plot2D : public SvgFileDrawable {
 	std::string plotTitle;
 	std::vector<std::unique_ptr<Axis>> xAxes, yAxes;
 	Bounds size;
+	bool axesPrepared = false;
 public:
 	Axis &x, &y;
 	/// Creates an X axis, covering some portion of the left/right side
 	Axis & newX(double lowRatio=0, double highRatio=1) {
-		Axis *x = new Axis(size.left + lowRatio*size.width(), size.left + highRatio*size.width());
+		Axis *x = new (this->arena()) Axis(size.left + lowRatio*size.width(), size.left + highRatio*size.width());
 		xAxes.emplace_back(x);
 		return *x;
 	}
 	/// Creates a Y axis, covering some portion of the bottom/top side
 	Axis & newY(double lowRatio=0, double highRatio=1) {
-		Axis *y = new Axis(size.bottom - lowRatio*size.height(), size.bottom - highRatio*size.height());
+		Axis *y = new (this->arena()) Axis(size.bottom - lowRatio*size.height(), size.bottom - highRatio*size.height());
 		yAxes.emplace_back(y);
 		return *y;
 	}
@@ -1459,7 +4213,7 @@ public:
 
 	Plot2D() : Plot2D(240, 130) {}
 	Plot2D(double width, double height) : Plot2D({0, width}, {height, 0}) {}
-	Plot2D(Axis ax, Axis ay) : size(ax.drawMin(), ax.drawMax(), ay.drawMin(), ay.drawMax()), x(*(new Axis(ax))), y(*(new Axis(ay))) {
+	Plot2D(Axis ax, Axis ay) : size(ax.drawMin(), ax.drawMax(), ay.drawMin(), ay.drawMax()), x(*(new (this->arena()) Axis(ax))), y(*(new (this->arena()) Axis(ay))) {
 		xAxes.emplace_back(&x); // created above, but we take ownership here
 		yAxes.emplace_back(&y);
 	}
@@ -1522,10 +4276,26 @@ public:
 		svg.raw("</g>");
 	}
 
-	void layout(const PlotStyle &style) override {
-		// Auto-scale axes if needed
+	void layoutKey(CacheKey &key) override {
+		key.add(xAxes.size()).add(yAxes.size());
+		for (auto &x : xAxes) x->layoutKey(key);
+		for (auto &y : yAxes) y->layoutKey(key);
+		SvgFileDrawable::layoutKey(key);
+	}
+	void prepareLayout(const PlotStyle &style) override {
+		// Linked axes can be shared between plots, so this can't happen during a multi-threaded layout
 		for (auto &x : xAxes) x->autoSetup();
 		for (auto &y : yAxes) y->autoSetup();
+		axesPrepared = true;
+		SvgFileDrawable::prepareLayout(style);
+	}
+	void layout(const PlotStyle &style) override {
+		// Auto-scale axes if needed
+		if (!axesPrepared) {
+			for (auto &x : xAxes) x->autoSetup();
+			for (auto &y : yAxes) y->autoSetup();
+		}
+		axesPrepared = false;
 
 		double tv = std::max(style.tickV, 0.0), th = std::max(style.tickH, 0.0);
 
@@ -1537,14 +4307,14 @@ public:
 			for (auto &t : x->tickList) {
 				double screenX = x->map(t.value);
 				if (t.name.size() && screenX >= xMin && screenX <= xMax) {
-					auto *label = new TextLabel({screenX, screenY}, 0, t.name, "svg-plot-value", false, true);
+					auto *label = new (this->arena()) TextLabel({screenX, screenY}, 0, t.name, "svg-plot-value", false, true);
 					this->addLayoutChild(label);
 				}
 			}
 			if (x->label().size()) {
 				double labelY = screenY + alignment*((style.labelSize + hasValues*style.valueSize)*0.5 + style.textPadding);
 				double midX = (x->drawMax() + x->drawMin())*0.5;
-				auto *label = new TextLabel({midX, labelY}, 0, x->label(), "svg-plot-label " + style.textClass(x->styleIndex), false, true);
+				auto *label = new (this->arena()) TextLabel({midX, labelY}, 0, x->label(), "svg-plot-label " + style.textClass(x->styleIndex), false, true);
 				this->addLayoutChild(label);
 		}
 		}
@@ -1556,11 +4326,11 @@ public:
 			for (auto &t : y->tickList) {
 				double screenY = y->map(t.value);
 				if (t.name.size() && screenY >= yMin && screenY <= yMax) {
-					auto *label = new TextLabel({screenX, screenY}, alignment, t.name, "svg-plot-value", false, true);
+					auto *label = new (this->arena()) TextLabel({screenX, screenY}, alignment, t.name, "svg-plot-value", false, true);
 					this->addLayoutChild(label);
 
 					double &longestLabel = y->flipped ? longestLabelRight : longestLabelLeft;
-					longestLabel = std::max(longestLabel, estimateUtf8Width(t.name.c_str()));
+					longestLabel = std::max(longestLabel, style.metrics().width(t.name));
 				}
 			}
 		}
@@ -1571,7 +4341,7 @@ public:
 				double longestLabel = y->flipped ? longestLabelRight : longestLabelLeft;
 				double labelX = screenX + alignment*(style.textPadding*1.5 + longestLabel*style.valueSize);
 				double midY = (y->drawMax() + y->drawMin())*0.5;
-				auto *label = new TextLabel({labelX, midY}, 0, y->label(), "svg-plot-label " + style.textClass(y->styleIndex), true, true);
+				auto *label = new (this->arena()) TextLabel({labelX, midY}, 0, y->label(), "svg-plot-label " + style.textClass(y->styleIndex), true, true);
 				this->addLayoutChild(label);
 			}
 		}
@@ -1581,7 +4351,7 @@ public:
 	};
 	
 	Line2D & line(Axis &x, Axis &y, PlotStyle::Counter styleIndex) {
-		Line2D *line = new Line2D(x, y, styleIndex);
+		Line2D *line = new (this->arena()) Line2D(x, y, styleIndex);
 		this->addChild(line);
 		return *line;
 	}
@@ -1605,13 +4375,13 @@ public:
 	If `xRatio` and `yRatio` are in the range 0-1, the legend will be inside the plot.  Otherwise, it will move outside the plot (e.g. -1 will be left/below the axes, including any labels).
 	*/
 	Legend & legend(double xRatio, double yRatio) {
-		Legend *legend = new Legend(*this, size, xRatio, yRatio);
+		Legend *legend = new (this->arena()) Legend(*this, size, xRatio, yRatio);
 		this->addChild(legend, true);
 		return *legend;
 	}
 	
 	Image & image(Axis &x, Axis &y, Bounds dataBounds, const std::string &url) {
-		Image *image = new Image(x, y, dataBounds, url);
+		Image *image = new (this->arena()) Image(x, y, dataBounds, url);
 		this->addChild(image);
 		return *image;
 	}
@@ -1631,12 +4401,12 @@ protected:
 	}
 public:
 	Plot2D & plot(double widthPt, double heightPt) {
-		Plot2D *axes = new Plot2D({0, widthPt}, {heightPt, 0});
+		Plot2D *axes = new (this->arena()) Plot2D({0, widthPt}, {heightPt, 0});
 		this->addChild(axes);
 		return *axes;
 	}
 	Plot2D & plot() {
-		Plot2D *axes = new Plot2D();
+		Plot2D *axes = new (this->arena()) Plot2D();
 		this->addChild(axes);
 		return *axes;
 	}
@@ -1648,22 +4418,57 @@ class Grid : public Cell {
 		int column, row;
 		std::unique_ptr<Grid> cell;
 		Point2D transpose = {0, 0};
-		Item(int column, int row) : column(column), row(row), cell(new Grid()) {}
+		Item(int column, int row, DrawableArena &arena) : column(column), row(row), cell(new (arena) Grid()) {
+			cell->shareArena(arena);
+		}
 	};
 	std::vector<Item> items;
 
 	void writeItems(bool label, SvgWriter &svg, const PlotStyle &style) {
-		for (auto &it : items) {
-			svg.tag("g").attr("transform", "translate(", it.transpose.x, " ", it.transpose.y, ")");
+		auto writeItem = [&](Item &it, SvgWriter &svg) {
 			if (label) {
 				it.cell->writeLabel(svg, style);
 			} else {
 				it.cell->writeData(svg, style);
 			}
+		};
+		// Cells are written separately (with scoped element IDs) and then copied in order
+		std::vector<BufferSink> buffers;
+		if (svg.threads > 1 && items.size() > 1 && !parallelForActive()) {
+			buffers.resize(items.size());
+			parallelFor(items.size(), svg.threads, [&](size_t i) {
+				SvgWriter cellSvg(buffers[i], svg, std::to_string(i) + (label ? "l-" : "-"));
+				writeItem(items[i], cellSvg);
+			});
+		}
+		for (size_t i = 0; i < items.size(); ++i) {
+			auto &it = items[i];
+			svg.tag("g").attr("transform", "translate(", it.transpose.x, " ", it.transpose.y, ")");
+			if (buffers.size()) {
+				svg.rawBytes(buffers[i].data(), buffers[i].size());
+			} else {
+				writeItem(it, svg);
+			}
 			svg.raw("</g>");
 		}
 	}
 protected:
+	void invalidateLayout() override {
+		Cell::invalidateLayout();
+		for (auto &it : items) it.cell->invalidateLayout();
+	}
+	void layoutKey(CacheKey &key) override {
+		key.add(items.size());
+		for (auto &it : items) {
+			key.add(it.column).add(it.row);
+			it.cell->layoutKey(key);
+		}
+		Cell::layoutKey(key);
+	}
+	void prepareLayout(const PlotStyle &style) override {
+		for (auto &it : items) it.cell->prepareLayoutIfNeeded(style);
+		Cell::prepareLayout(style);
+	}
 	void layout(const PlotStyle &style) override {
 		struct Range {
 			double min = 0, max = 0;
@@ -1676,6 +4481,13 @@ protected:
 		};
 		std::vector<Range> colRange(_colMax - _colMin + 1);
 		std::vector<Range> rowRange(_rowMax - _rowMin + 1);
+		int threads = style.threadCount();
+		if (threads > 1 && items.size() > 1 && !parallelForActive()) {
+			for (auto &it : items) it.cell->prepareLayoutIfNeeded(style);
+			parallelFor(items.size(), threads, [&](size_t i) {
+				items[i].cell->layoutIfNeeded(style);
+			});
+		}
 		for (auto &it : items) {
 			Bounds bounds = it.cell->layoutIfNeeded(style);
 			colRange[it.column - _colMin].include(bounds.left).include(bounds.right);
@@ -1725,7 +4537,7 @@ public:
 				return *it.cell;
 			}
 		}
-		items.emplace_back(column, row);
+		items.emplace_back(column, row, this->arena());
 		return *(items.back().cell);
 	}
 
@@ -1747,16 +4559,139 @@ class Figure : public Grid {
 public:
 	PlotStyle style;
 	PlotStyle defaultStyle() const override {
+		// Compiled here, so that the copies share it
+		style.compile();
 		return style;
 	}
 	
 	Figure() : style(Grid::defaultStyle()) {}
 };
 
+/** Writes many drawables to files, across a pool of worker threads.
+
+	Jobs for the same drawable run one at a time, in the order they were added.  Different drawables are written concurrently, so they shouldn't share axes or lines, and shouldn't be changed until `.finish()` returns.
+	
+	Each job streams straight to its file, and `.add()` waits while too many jobs are pending, so memory use stays bounded however many jobs there are.
+*/
+class BatchWriter {
+public:
+	struct Result {
+		std::string file;
+		bool ok = false;
+		double seconds = 0; ///< Time spent writing (not waiting)
+		std::string error;
+	};
+	
+	/// `threads = 0` uses all cores.  `maxPending` limits the queued and running jobs (0 = twice the threads).
+	BatchWriter(int threads=0, size_t maxPending=0) {
+		threadCount = (threads > 0) ? threads : std::max<int>(1, std::thread::hardware_concurrency());
+		this->maxPending = maxPending ? maxPending : 2*threadCount;
+	}
+	~BatchWriter() {
+		finish();
+	}
+	BatchWriter(const BatchWriter &other) = delete;
+
+	/// Adds a job, waiting if too many are pending.  The style is copied.
+	void add(SvgFileDrawable &drawable, const std::string &file, const PlotStyle &style) {
+		// Compiled here, so the copy (and any later ones) share it
+		style.compile();
+		std::unique_lock<std::mutex> lock(mutex);
+		if (workers.empty()) {
+			finishing = false;
+			for (int t = 0; t < threadCount; ++t) {
+				workers.emplace_back([this]() {work();});
+			}
+		}
+		spaceCondition.wait(lock, [&]() {
+			return pending.size() + busy.size() < maxPending;
+		});
+		pending.push_back(Job{&drawable, style, results.size()});
+		results.push_back(Result());
+		results.back().file = file;
+		workCondition.notify_one();
+	}
+	void add(SvgFileDrawable &drawable, const std::string &file) {
+		add(drawable, file, drawable.defaultStyle());
+	}
+
+	/// Waits for all the jobs, and returns their results (in the order they were added)
+	std::vector<Result> finish() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finishing = true;
+		}
+		workCondition.notify_all();
+		for (auto &worker : workers) worker.join();
+		workers.clear();
+		std::vector<Result> done;
+		std::swap(done, results);
+		return done;
+	}
+private:
+	struct Job {
+		SvgFileDrawable *drawable;
+		PlotStyle style;
+		size_t resultIndex;
+	};
+	int threadCount;
+	size_t maxPending;
+	std::mutex mutex;
+	std::condition_variable workCondition, spaceCondition;
+	std::deque<Job> pending;
+	std::vector<SvgFileDrawable *> busy;
+	std::vector<Result> results;
+	std::vector<std::thread> workers;
+	bool finishing = false;
+
+	void work() {
+		// Any threading inside each job would compete with the other workers
+		parallelForActive() = true;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			auto jobIter = std::find_if(pending.begin(), pending.end(), [&](const Job &job) {
+				return std::find(busy.begin(), busy.end(), job.drawable) == busy.end();
+			});
+			if (jobIter == pending.end()) {
+				if (finishing && pending.empty()) break;
+				workCondition.wait(lock);
+				continue;
+			}
+			Job job = std::move(*jobIter);
+			pending.erase(jobIter);
+			busy.push_back(job.drawable);
+			std::string file = results[job.resultIndex].file;
+			lock.unlock();
+
+			bool ok = false;
+			std::string error;
+			auto start = std::chrono::steady_clock::now();
+			try {
+				ok = job.drawable->write(file, job.style);
+				if (!ok) error = "could not write file";
+			} catch (const std::exception &e) {
+				error = e.what();
+			}
+			std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+			lock.lock();
+			busy.erase(std::find(busy.begin(), busy.end(), job.drawable));
+			Result &result = results[job.resultIndex];
+			result.ok = ok;
+			result.seconds = seconds.count();
+			result.error = error;
+			// A slot is free, and other jobs for this drawable might be runnable now
+			spaceCondition.notify_all();
+			workCondition.notify_all();
+		}
+		parallelForActive() = false;
+	}
+};
+
 static double estimateCharWidth(int c) {
 	// measured experimentally, covering basic Latin (no accents) and Greek
 	if (c >= 32 && c < 127) {
-		static char w[95] = {31, 36, 45, 70, 61, 95, 77, 29, 39, 39, 40, 72, 31, 39, 31, 44, 61, 54, 58, 59, 59, 58, 59, 58, 59, 59, 38, 38, 74, 100, 74, 54, 97, 69, 66, 71, 76, 64, 62, 76, 77, 41, 53, 69, 57, 89, 76, 78, 63, 80, 68, 64, 62, 75, 67, 96, 69, 64, 64, 41, 46, 41, 68, 59, 54, 57, 59, 52, 59, 56, 38, 58, 58, 29, 33, 53, 30, 87, 58, 57, 59, 59, 43, 49, 38, 58, 53, 77, 54, 53, 50, 47, 46, 47, 69};
+		static const char w[95] = {31, 36, 45, 70, 61, 95, 77, 29, 39, 39, 40, 72, 31, 39, 31, 44, 61, 54, 58, 59, 59, 58, 59, 58, 59, 59, 38, 38, 74, 100, 74, 54, 97, 69, 66, 71, 76, 64, 62, 76, 77, 41, 53, 69, 57, 89, 76, 78, 63, 80, 68, 64, 62, 75, 67, 96, 69, 64, 64, 41, 46, 41, 68, 59, 54, 57, 59, 52, 59, 56, 38, 58, 58, 29, 33, 53, 30, 87, 58, 57, 59, 59, 43, 49, 38, 58, 53, 77, 54, 53, 50, 47, 46, 47, 69};
 		return w[c - 32]*0.01;
 	} else if (c == 168) {
 		return 0.53;
@@ -1765,32 +4700,32 @@ static double estimateCharWidth(int c) {
 	} else if (c == 697) {
 		return 0.26;
 	} else if (c >= 880 && c < 884) {
-		static char w[4] = {42, 31, 64, 52};
+		static const char w[4] = {42, 31, 64, 52};
 		return w[c - 880]*0.01;
 	} else if (c >= 885 && c < 888) {
-		static char w[3] = {40, 66, 48};
+		static const char w[3] = {40, 66, 48};
 		return w[c - 885]*0.01;
 	} else if (c >= 890 && c < 894) {
-		static char w[4] = {33, 52, 52, 52};
+		static const char w[4] = {33, 52, 52, 52};
 		return w[c - 890]*0.01;
 	} else if (c == 895) {
 		return 0.33;
 	} else if (c == 900) {
 		return 0.52;
 	} else if (c >= 913 && c < 930) {
-		static char w[17] = {75, 71, 63, 73, 71, 71, 82, 82, 45, 77, 75, 94, 81, 70, 83, 85, 67};
+		static const char w[17] = {75, 71, 63, 73, 71, 71, 82, 82, 45, 77, 75, 94, 81, 70, 83, 85, 67};
 		return w[c - 913]*0.01;
 	} else if (c >= 931 && c < 938) {
-		static char w[7] = {69, 65, 70, 82, 80, 85, 84};
+		static const char w[7] = {69, 65, 70, 82, 80, 85, 84};
 		return w[c - 931]*0.01;
 	} else if (c >= 945 && c < 970) {
-		static char w[25] = {61, 58, 57, 57, 49, 50, 58, 60, 29, 57, 55, 59, 53, 51, 57, 63, 59, 50, 59, 48, 58, 72, 56, 76, 76};
+		static const char w[25] = {61, 58, 57, 57, 49, 50, 58, 60, 29, 57, 55, 59, 53, 51, 57, 63, 59, 50, 59, 48, 58, 72, 56, 76, 76};
 		return w[c - 945]*0.01;
 	} else if (c >= 975 && c < 979) {
-		static char w[4] = {47, 66, 74, 66};
+		static const char w[4] = {47, 66, 74, 66};
 		return w[c - 975]*0.01;
 	} else if (c >= 981 && c < 1024) {
-		static char w[43] = {80, 86, 56, 79, 63, 68, 67, 57, 53, 60, 53, 75, 85, 86, 85, 69, 56, 70, 53, 69, 69, 61, 61, 75, 56, 43, 37, 59, 63, 46, 29, 79, 55, 55, 62, 63, 71, 87, 75, 75, 75, 75, 75};
+		static const char w[43] = {80, 86, 56, 79, 63, 68, 67, 57, 53, 60, 53, 75, 85, 86, 85, 69, 56, 70, 53, 69, 69, 61, 61, 75, 56, 43, 37, 59, 63, 46, 29, 79, 55, 55, 62, 63, 71, 87, 75, 75, 75, 75, 75};
 		return w[c - 981]*0.01;
 	} else if (c == 65291) {
 		return 1;
@@ -1798,17 +4733,6 @@ static double estimateCharWidth(int c) {
 	return 0.85;
 }
 
-/// Estimates string width encoded with UTF-8
-static double estimateUtf8Width(const char *utf8Str) {
-	/// TODO: UTF-8 decoding!
-	double total = 0;
-	while (*utf8Str) {
-		total += estimateCharWidth(*utf8Str);
-		++utf8Str;
-	}
-	return total;
-}
-
 /// @}
 }}; // namespace
 